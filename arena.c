@@ -0,0 +1,83 @@
+/*
+ *  CS347 arena.c
+ *  
+ */ 
+#include <stdlib.h>
+#include <string.h> 
+#include <stdalign.h>
+#include <stdint.h>
+#include <assert.h>
+#include "arena.h"
+
+/* CONSTANTS */
+
+#define ARENA_BLOCK 65536
+
+static_assert(offsetof(struct ArenaBlock, data) % alignof(max_align_t) == 0,
+        "arena block data must be aligned for any type");
+
+/* Arena Alloc
+ * arena    The arena to allocate from.
+ * size     The number of bytes needed.
+ *
+ * Rounds size up to the strictest alignment and bumps the front block.
+ * When it is full a new block is put in front; a request larger than
+ * a block gets a block of its own behind the front one, so the space
+ * left in the front block is not wasted. malloc aligns each block and
+ * the header aligns its data, so every result is aligned for any type.
+ */
+void *arenaAlloc(struct Arena *arena, size_t size){
+    size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+    if(size == 0){
+        size = align;
+    }
+    struct ArenaBlock *block = arena->blocks;
+    if(block == NULL || block->size - block->used < size){
+        size_t blockSize = size > ARENA_BLOCK/4 ? size : ARENA_BLOCK;
+        struct ArenaBlock *fresh = malloc(sizeof(struct ArenaBlock) + blockSize);
+        fresh->size = blockSize;
+        fresh->used = 0;
+        if(block != NULL && blockSize == size){
+            fresh->next = block->next;
+            block->next = fresh;
+        } else {
+            fresh->next = block;
+            arena->blocks = fresh;
+        }
+        block = fresh;
+    }
+    void *result = &block->data[block->used];
+    assert((uintptr_t)result % align == 0);
+    block->used += size;
+    memset(result, 0, size);
+    return result;
+}
+
+/* Arena Copy
+ * arena    The arena to allocate from.
+ * string   The string to copy.
+ *
+ * Allocates strlen(string)+1 bytes and copies string into them.
+ */
+char *arenaCopy(struct Arena *arena, const char *string){
+    size_t len = strlen(string)+1;
+    char *copy = arenaAlloc(arena, len);
+    memcpy(copy, string, len);
+    return copy;
+}
+
+/* Arena Free
+ * arena    The arena to release.
+ *
+ * Walks the block list freeing each block.
+ */
+void arenaFree(struct Arena *arena){
+    struct ArenaBlock *block = arena->blocks;
+    while(block != NULL){
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
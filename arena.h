@@ -0,0 +1,58 @@
+#ifndef __ARENA__H__
+#define __ARENA__H__
+/*
+ *  CS347 arena.h
+ * 
+ */ 
+
+#include <stddef.h>
+#include <stdalign.h>
+
+/* Arena Block Structure
+ *
+ * One chunk of memory handed out by an arena, front to back. data is
+ * aligned for any type, so that allocations rounded to that alignment
+ * stay aligned too.
+ */
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];
+};
+
+/* Arena Structure
+ *
+ * A bump allocator: allocations are carved one after another out of 
+ * large blocks and are never freed on their own, only all together
+ * with arenaFree. An arena whose blocks pointer is NULL is empty and 
+ * ready to use.
+ */
+struct Arena {
+    struct ArenaBlock *blocks;
+};
+
+/* Arena Alloc
+ * arena    The arena to allocate from.
+ * size     The number of bytes needed.
+ *
+ * Returns size bytes of zeroed memory aligned for any type.
+ */
+void *arenaAlloc(struct Arena *arena, size_t size);
+
+/* Arena Copy
+ * arena    The arena to allocate from.
+ * string   The string to copy.
+ *
+ * Returns a copy of string that lives in the arena.
+ */
+char *arenaCopy(struct Arena *arena, const char *string);
+
+/* Arena Free
+ * arena    The arena to release.
+ *
+ * Frees every block at once, leaving the arena empty.
+ */
+void arenaFree(struct Arena *arena);
+
+#endif
@@ -11,6 +11,7 @@
 #include <sys/wait.h>
 #include <string.h> 
 #include <ctype.h>
+#include <fcntl.h>
 #include "arg_parse.h"
 
 /* Arg Count
@@ -62,3 +63,42 @@ char **arg_parse(char *line, int *argcp){
     return args;
 }
 
+/* Parse Redirections
+ * Loops through 'args' looking for the IO characters (>, >>, <). Each one followed by a file name 
+ * becomes an entry in 'redirects' with the flags open() needs: truncate or append for output, read 
+ * only for input. The first IO character is then replaced with NULL so that only the command 
+ * itself is left in 'args'.
+ */
+int parseRedirections(char **args, struct Redirect *redirects){
+    int count = 0;
+    int end = -1;
+    for(int i = 0; args[i] != NULL; i++){
+        int fd = -1;
+        int flags = 0;
+        if(strcmp(args[i], ">") == 0){// Truncate 
+            fd = 1;
+            flags = O_TRUNC | O_WRONLY | O_CREAT;
+        } else if(strcmp(args[i], ">>") == 0){// Append
+            fd = 1;
+            flags = O_WRONLY | O_APPEND | O_CREAT;
+        } else if(strcmp(args[i], "<") == 0){// Input
+            fd = 0;
+            flags = O_RDONLY;
+        }
+        if(fd != -1){
+            if(end == -1){
+                end = i;
+            }
+            if(args[i+1] != NULL){
+                redirects[count].fd = fd;
+                redirects[count].flags = flags;
+                redirects[count].file = args[i+1];
+                count++;
+            }
+        }
+    }
+    if(end != -1){
+        args[end] = NULL;
+    }
+    return count;
+}
@@ -15,4 +15,25 @@
  */
 char **arg_parse(char* line, int *argcp);
 
+/* Redirect Structure
+ *
+ * One I/O redirection found in a parsed line: the descriptor it 
+ * replaces (0 or 1), the open() flags to use and the file name.
+ */
+struct Redirect {
+    int fd;
+    int flags;
+    char *file;
+};
+
+/* Parse Redirections
+ * args       A parsed line, as returned by arg_parse.
+ * redirects  An array with room for at least as many entries as args.
+ *
+ * Finds every <, > and >> followed by a file name and records it in
+ * redirects, in order. The command ends at the first of them, so args
+ * is cut there. Returns the number of redirections found.
+ */
+int parseRedirections(char **args, struct Redirect *redirects);
+
 #endif
\ No newline at end of file
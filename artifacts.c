@@ -0,0 +1,197 @@
+/*
+ *  CS347 artifacts.c
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+#include "target.h"
+#include "builddb.h"
+#include "tracedeps.h"
+#include "artifacts.h"
+
+/* CONSTANTS */
+
+#define COPY_BUFFER 65536
+
+/* Entry Path
+ * dir      The cache directory.
+ * key      An artifact key.
+ * path     A buffer of PATH_MAX bytes for the entry's path.
+ * fanout   A buffer of PATH_MAX bytes for the directory holding it.
+ *
+ * Entries are spread over 256 subdirectories by the top byte of their
+ * key, so no single directory grows too large. Returns -1 if dir is
+ * too long for the paths to fit, 0 otherwise.
+ */
+static int entryPath(const char *dir, unsigned long long key, char *path, char *fanout){
+    int length = snprintf(fanout, PATH_MAX, "%s/%02llx", dir, key >> 56);
+    if(length < 0 || length >= PATH_MAX){
+        return -1;
+    }
+    length = snprintf(path, PATH_MAX, "%s/%016llx", fanout, key);
+    if(length < 0 || length >= PATH_MAX){
+        return -1;
+    }
+    return 0;
+}
+
+/* Copy Contents
+ * in       The open source file.
+ * out      The open, empty destination file.
+ *
+ * Tries a reflink (FICLONE) first, which shares the blocks on file
+ * systems that support it, then copy_file_range, which lets the kernel
+ * copy without going through umake, and finally read and write for
+ * whatever is left. Returns 0 on success, -1 on failure.
+ */
+static int copyContents(int in, int out){
+    if(ioctl(out, FICLONE, in) == 0){
+        return 0;
+    }
+    ssize_t copied;
+    do {
+        copied = copy_file_range(in, NULL, out, NULL, COPY_BUFFER*16, 0);
+    } while(copied > 0);
+    if(copied == 0){
+        return 0;
+    }
+
+    char *buffer = malloc(COPY_BUFFER);
+    int status = 0;
+    ssize_t got;
+    while((got = read(in, buffer, COPY_BUFFER)) != 0){
+        if(got == -1 && errno == EINTR){
+            continue;
+        } else if(got == -1){
+            status = -1;
+            break;
+        }
+        ssize_t written = 0;
+        while(written < got){
+            ssize_t now = write(out, buffer + written, got - written);
+            if(now == -1 && errno == EINTR){
+                continue;
+            } else if(now == -1){
+                status = -1;
+                break;
+            }
+            written += now;
+        }
+        if(status == -1){
+            break;
+        }
+    }
+    free(buffer);
+    return status;
+}
+
+/* Copy File
+ * source   A regular file.
+ * dest     Where to copy it.
+ *
+ * Copies source (with its permissions) to a temporary name next to
+ * dest and renames it over dest, so dest is never left half written.
+ * Returns 0 on success, -1 on failure.
+ */
+static int copyFile(const char *source, const char *dest){
+    int in = open(source, O_RDONLY | O_CLOEXEC);
+    if(in == -1){
+        return -1;
+    }
+    struct stat sourceStat;
+    if(fstat(in, &sourceStat) == -1 || !S_ISREG(sourceStat.st_mode)){
+        close(in);
+        return -1;
+    }
+    char temp[PATH_MAX];
+    snprintf(temp, sizeof(temp), "%s.umake-%d", dest, (int)getpid());
+    int out = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, sourceStat.st_mode & 0777);
+    if(out == -1){
+        close(in);
+        return -1;
+    }
+    int status = copyContents(in, out);
+    if(close(out) == -1){
+        status = -1;
+    }
+    close(in);
+    if(status == 0 && rename(temp, dest) == -1){
+        status = -1;
+    }
+    if(status == -1){
+        unlink(temp);
+    }
+    return status;
+}
+
+/* Artifact Key
+ * target   A target whose dependencies are up to date.
+ * rules    The digest of its expanded rule text.
+ *
+ * Chains digestBytes over the pieces, ending each name with its NUL
+ * so that names cannot run into each other. The dependencies traced 
+ * for the target (see tracedDeps) follow the declared ones.
+ */
+unsigned long long artifactKey(struct Target *target, unsigned long long rules){
+    unsigned long long key = digestBytes(target->targetName, strlen(target->targetName)+1, 0);
+    key = digestBytes(&rules, sizeof(rules), key);
+    int tracedCount;
+    char **traced = tracedDeps(target->targetName, &tracedCount);
+    for(int i = 0; i < target->depCount + tracedCount; i++){
+        const char *dep = i < target->depCount ? target->depNames[i] : traced[i - target->depCount];
+        unsigned long long content = fileDigest(dep);
+        key = digestBytes(dep, strlen(dep)+1, key);
+        key = digestBytes(&content, sizeof(content), key);
+    }
+    return key;
+}
+
+/* Restore Artifact
+ * dir      The cache directory.
+ * key      The key from artifactKey.
+ * path     The target's output file.
+ *
+ * Entries are copied out rather than hard linked: a link would give
+ * the output the entry's old modification time, and a rule that later
+ * changed the output in place would change the cached copy too.
+ */
+int restoreArtifact(const char *dir, unsigned long long key, const char *path){
+    char entry[PATH_MAX];
+    char fanout[PATH_MAX];
+    if(entryPath(dir, key, entry, fanout) == -1 || access(entry, R_OK) == -1){
+        return 0;
+    }
+    return copyFile(entry, path) == 0;
+}
+
+/* Store Artifact
+ * dir      The cache directory.
+ * key      The key from artifactKey.
+ * path     The output a target's rules just made.
+ *
+ * Only the cache directory and its fan-out directory are created, not
+ * their parents.
+ */
+int storeArtifact(const char *dir, unsigned long long key, const char *path){
+    char entry[PATH_MAX];
+    char fanout[PATH_MAX];
+    if(entryPath(dir, key, entry, fanout) == -1){
+        return -1;
+    }
+    if(mkdir(dir, 0777) == -1 && errno != EEXIST){
+        return -1;
+    }
+    if(mkdir(fanout, 0777) == -1 && errno != EEXIST){
+        return -1;
+    }
+    return copyFile(path, entry);
+}
@@ -0,0 +1,44 @@
+#ifndef __ARTIFACTS__H__
+#define __ARTIFACTS__H__
+/*
+ *  CS347 artifacts.h
+ *
+ */
+
+#include "target.h"
+
+/* Artifact Key
+ * target   A target whose dependencies are up to date.
+ * rules    The digest of its expanded rule text.
+ *
+ * Returns the key target's output is cached under: a digest of its
+ * name, its rules and the name and content digest of each of its
+ * dependencies, declared or traced. The same target built from the
+ * same inputs in another worktree gets the same key.
+ */
+unsigned long long artifactKey(struct Target *target, unsigned long long rules);
+
+/* Restore Artifact
+ * dir      The cache directory.
+ * key      The key from artifactKey.
+ * path     The target's output file.
+ *
+ * If the cache holds an entry for key, puts a copy of it at path (a
+ * reflink where the file system allows it) with a fresh modification
+ * time. Returns 1 if path was restored, 0 if the rules have to run.
+ */
+int restoreArtifact(const char *dir, unsigned long long key, const char *path);
+
+/* Store Artifact
+ * dir      The cache directory.
+ * key      The key from artifactKey.
+ * path     The output a target's rules just made.
+ *
+ * Copies path into the cache under key, creating the directory if
+ * needed. Entries are written to a temporary name and renamed into
+ * place, so several umakes may share one cache. Returns 0 on success
+ * and -1 if nothing was stored (such as when path is not a file).
+ */
+int storeArtifact(const char *dir, unsigned long long key, const char *path);
+
+#endif
@@ -0,0 +1,355 @@
+/*
+ *  CS347 bench.c
+ *
+ *  Benchmark harness for umake: generates a uMakefile of each requested
+ *  shape with gengraph, then times a full build, a no-op build and a
+ *  no-op build through the graph cache, reporting the phase times umake
+ *  prints with --stats, its peak RSS and (with -t) its system calls.
+ *
+ *  usage: bench [-n targets] [-l length] [-v vars] [-u umake]
+ *               [-g gengraph] [-t] [shape ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* CONSTANTS */
+
+#define DEFAULT_UMAKE "./umake"
+#define DEFAULT_GENGRAPH "./bench/gengraph"
+#define STATS_PREFIX "umake-stats "
+
+/* Result Structure
+ *
+ * What one run of a command measured. The phase times are -1 when the
+ * command printed no umake-stats line, and syscalls is -1 when they
+ * were not counted.
+ */
+struct Result {
+    double wall;
+    double load;
+    double graph;
+    double build;
+    int cached;
+    long rss;
+    long syscalls;
+    int status;
+};
+
+/* Run Structure
+ *
+ * One of the builds timed for every shape: its name, the umake
+ * options it is run with and whether it is reported (the warm-up that
+ * writes the graph cache is not).
+ */
+struct Run {
+    const char *name;
+    const char *option;
+    int report;
+};
+
+static struct Run runs[] = {
+    {"full",   "--no-graph-cache", 1},
+    {"noop",   "--no-graph-cache", 1},
+    {"warmup", NULL, 0},
+    {"cached", NULL, 1},
+    {NULL, NULL, 0}
+};
+
+static const char *defaultShapes[] = {"chain", "wide", "fanout", "diamond", "tree", NULL};
+
+/* Now
+ *
+ * Returns the time of the monotonic clock in seconds.
+ */
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/* Trace Children
+ * pid      The traced child, stopped before its exec.
+ * result   Filled in with the count of system calls and the child's
+ *          peak RSS and exit status.
+ *
+ * Follows the child and everything it starts (forks, vforks and
+ * threads are attached automatically) from system call stop to system
+ * call stop until all of them have exited. Each call stops once on
+ * entry and once on exit, so the count is half the stops.
+ */
+static void traceChildren(pid_t pid, struct Result *result){
+    ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK
+            | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, pid, 0, 0);
+
+    long stops = 0;
+    int status;
+    struct rusage usage;
+    pid_t stopped;
+    while((stopped = wait4(-1, &status, __WALL, &usage)) != -1 || errno == EINTR){
+        if(stopped == -1){
+            continue;
+        }
+        if(WIFEXITED(status) || WIFSIGNALED(status)){
+            if(stopped == pid){
+                result->rss = usage.ru_maxrss;
+                result->status = status;
+            }
+            continue;
+        }
+        int deliver = 0;
+        int sig = WSTOPSIG(status);
+        if(sig == (SIGTRAP | 0x80)){
+            stops++;
+        } else if(sig != SIGSTOP && sig != SIGTRAP){
+            deliver = sig;
+        }
+        ptrace(PTRACE_SYSCALL, stopped, 0, deliver);
+    }
+    result->syscalls = stops / 2;
+}
+
+/* Run Command
+ * argv     The command and its arguments; argv[0] is a path.
+ * dir      The directory to run it in.
+ * output   The file its standard output goes to.
+ * errors   The file its standard error goes to, or NULL to keep bench's.
+ * trace    Whether to count its system calls.
+ * result   Filled in with the measurements.
+ *
+ * Returns 0 if the command ran, -1 if it could not be started.
+ */
+static int runCommand(char *argv[], const char *dir, const char *output, const char *errors,
+        int trace, struct Result *result){
+    result->syscalls = -1;
+    result->rss = 0;
+    double start = now();
+    pid_t pid = fork();
+    if(pid == -1){
+        perror("fork");
+        return -1;
+    }
+    if(pid == 0){
+        int out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = errors != NULL ? open(errors, O_WRONLY | O_CREAT | O_TRUNC, 0644) : STDERR_FILENO;
+        if(chdir(dir) == -1 || out == -1 || err == -1){
+            _exit(127);
+        }
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        if(trace){
+            if(ptrace(PTRACE_TRACEME, 0, 0, 0) == -1){
+                _exit(126);
+            }
+            raise(SIGSTOP);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if(trace){
+        waitpid(pid, &status, 0);
+        if(WIFSTOPPED(status)){
+            traceChildren(pid, result);
+        } else {
+            result->status = status;
+        }
+    } else {
+        wait4(pid, &status, 0, &usage);
+        result->rss = usage.ru_maxrss;
+        result->status = status;
+    }
+    result->wall = now() - start;
+    return 0;
+}
+
+/* Read Stats
+ * errors   The file umake's standard error went to.
+ * result   Filled in with the phase times.
+ *
+ * Looks for the line umake --stats prints.
+ */
+static void readStats(const char *errors, struct Result *result){
+    result->load = result->graph = result->build = -1;
+    result->cached = 0;
+    FILE *file = fopen(errors, "r");
+    if(file == NULL){
+        return;
+    }
+    char *line = NULL;
+    size_t size = 0;
+    while(getline(&line, &size, file) != -1){
+        if(strncmp(line, STATS_PREFIX, strlen(STATS_PREFIX)) == 0){
+            sscanf(line, STATS_PREFIX "cached=%d targets=%*d load=%lf graph=%lf save=%*f build=%lf",
+                    &result->cached, &result->load, &result->graph, &result->build);
+        }
+    }
+    free(line);
+    fclose(file);
+}
+
+/* Remove Directory
+ * dir      A scratch directory.
+ *
+ * Removes dir and everything in it with rm -rf.
+ */
+static void removeDirectory(const char *dir){
+    char *argv[] = {"/bin/rm", "-rf", (char *)dir, NULL};
+    struct Result ignored;
+    runCommand(argv, "/", "/dev/null", "/dev/null", 0, &ignored);
+}
+
+/* Bench Shape
+ * umake    The absolute path of umake.
+ * gengraph The absolute path of gengraph.
+ * shape    The graph shape.
+ * options  The size, line length and variable options for gengraph.
+ * trace    Whether to count system calls.
+ *
+ * Generates the uMakefile in a scratch directory and prints one row
+ * for each reported run.
+ */
+static void benchShape(const char *umake, const char *gengraph, const char *shape,
+        char *options[], int trace){
+    char dir[] = "/tmp/umake-bench-XXXXXX";
+    if(mkdtemp(dir) == NULL){
+        perror("mkdtemp");
+        return;
+    }
+    char makefile[PATH_MAX];
+    char errors[PATH_MAX];
+    snprintf(makefile, sizeof(makefile), "%s/uMakefile", dir);
+    snprintf(errors, sizeof(errors), "%s/.bench-stderr", dir);
+
+    char *generate[] = {(char *)gengraph, "-s", (char *)shape, options[0], options[1],
+        options[2], options[3], options[4], options[5], NULL};
+    struct Result result;
+    if(runCommand(generate, dir, makefile, NULL, 0, &result) == -1
+            || !WIFEXITED(result.status) || WEXITSTATUS(result.status) != 0){
+        fprintf(stderr, "bench: gengraph failed for %s\n", shape);
+        removeDirectory(dir);
+        return;
+    }
+
+    for(struct Run *run = runs; run->name != NULL; run++){
+        char *argv[] = {(char *)umake, "--stats", (char *)run->option, "all", NULL};
+        if(run->option == NULL){
+            argv[2] = "all";
+            argv[3] = NULL;
+        }
+        if(runCommand(argv, dir, "/dev/null", errors, trace, &result) == -1){
+            break;
+        }
+        readStats(errors, &result);
+        if(!run->report){
+            continue;
+        }
+        printf("%-8s %-8s %9s %8.3f", shape, options[1], run->name, result.wall);
+        if(result.load >= 0){
+            printf(" %8.3f %8.3f %8.3f", result.load, result.graph, result.build);
+        } else {
+            printf(" %8s %8s %8s", "-", "-", "-");
+        }
+        printf(" %9ld", result.rss);
+        if(result.syscalls >= 0){
+            printf(" %9ld", result.syscalls);
+        } else {
+            printf(" %9s", "-");
+        }
+        if(!WIFEXITED(result.status) || WEXITSTATUS(result.status) != 0){
+            printf("  (failed)");
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    removeDirectory(dir);
+}
+
+/* Usage
+ * Prints how to run bench, then exits.
+ */
+static void usage(){
+    fprintf(stderr, "usage: bench [-n targets] [-l length] [-v vars] [-u umake] [-g gengraph] [-t] [shape ...]\n");
+    fprintf(stderr, "  -t  count system calls with ptrace (makes the runs slower)\n");
+    exit(1);
+}
+
+/* Main entry point.
+ * argc    A count of command-line arguments
+ * argv    The command-line argument values
+ *
+ * Benchmarks each shape given (or every shape gengraph knows) and
+ * prints a table: wall time, umake's load, graph and build phases (in
+ * seconds), peak RSS in kilobytes and system calls made by umake and
+ * the commands it ran.
+ */
+int main(int argc, char *argv[]){
+    const char *umake = DEFAULT_UMAKE;
+    const char *gengraph = DEFAULT_GENGRAPH;
+    char *targets = "10000";
+    char *length = "0";
+    char *vars = "0";
+    int trace = 0;
+    int opt;
+    while((opt = getopt(argc, argv, "n:l:v:u:g:t")) != -1){
+        switch(opt){
+            case 'n':
+                targets = optarg;
+                break;
+            case 'l':
+                length = optarg;
+                break;
+            case 'v':
+                vars = optarg;
+                break;
+            case 'u':
+                umake = optarg;
+                break;
+            case 'g':
+                gengraph = optarg;
+                break;
+            case 't':
+                trace = 1;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    char umakePath[PATH_MAX];
+    char gengraphPath[PATH_MAX];
+    if(realpath(umake, umakePath) == NULL){
+        fprintf(stderr, "bench: cannot find umake at %s\n", umake);
+        exit(1);
+    }
+    if(realpath(gengraph, gengraphPath) == NULL){
+        fprintf(stderr, "bench: cannot find gengraph at %s\n", gengraph);
+        exit(1);
+    }
+
+    char *options[] = {"-n", targets, "-l", length, "-v", vars};
+    printf("%-8s %-8s %9s %8s %8s %8s %8s %9s %9s\n", "shape", "targets", "run",
+            "wall", "load", "graph", "build", "rss(KB)", "syscalls");
+    if(optind < argc){
+        for(int i = optind; i < argc; i++){
+            benchShape(umakePath, gengraphPath, argv[i], options, trace);
+        }
+    } else {
+        for(int i = 0; defaultShapes[i] != NULL; i++){
+            benchShape(umakePath, gengraphPath, defaultShapes[i], options, trace);
+        }
+    }
+    return 0;
+}
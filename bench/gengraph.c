@@ -0,0 +1,190 @@
+/*
+ *  CS347 gengraph.c
+ *
+ *  Writes a synthetic uMakefile to standard output, for benchmarking
+ *  umake on graphs of a chosen shape and size.
+ *
+ *  usage: gengraph [-n targets] [-s shape] [-l length] [-v vars]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* CONSTANTS */
+
+#define DEFAULT_TARGETS 10000
+
+/* OPTIONS */
+
+/* The number of targets t0 .. t(n-1), not counting all. */
+static long targets = DEFAULT_TARGETS;
+
+/* The number of padding characters added to each target's second rule
+ * line, to make long lines. */
+static long lineLength = 0;
+
+/* The number of variables VAR0 .. VAR(v-1), each one referring to the
+ * one before it; every second rule line uses the last one. */
+static long variables = 0;
+
+/* Shape Structure
+ *
+ * A named graph shape and the function writing the dependency list of
+ * target i for it, or NULL if its targets are all leaves.
+ */
+struct Shape {
+    const char *name;
+    const char *description;
+    void (*dependencies)(long i);
+};
+
+/* Chain Dependencies
+ * i    The target whose dependencies are written.
+ *
+ * t0 depends on t1, which depends on t2, and so on: one path as deep
+ * as the graph.
+ */
+static void chainDependencies(long i){
+    if(i+1 < targets){
+        printf(" t%ld", i+1);
+    }
+}
+
+/* Fanout Dependencies
+ * i    The target whose dependencies are written.
+ *
+ * Every target depends on t0 (fan-out), and all on each of them.
+ */
+static void fanoutDependencies(long i){
+    if(i != 0){
+        printf(" t0");
+    }
+}
+
+/* Diamond Dependencies
+ * i    The target whose dependencies are written.
+ *
+ * A chain of diamonds: t(3k) depends on t(3k+1) and t(3k+2), which
+ * both depend on t(3k+3).
+ */
+static void diamondDependencies(long i){
+    long next = i%3 == 0 ? i+1 : i - i%3 + 3;
+    if(next < targets){
+        printf(" t%ld", next);
+    }
+    if(i%3 == 0 && i+2 < targets){
+        printf(" t%ld", i+2);
+    }
+}
+
+/* Tree Dependencies
+ * i    The target whose dependencies are written.
+ *
+ * A binary tree: ti depends on t(2i+1) and t(2i+2).
+ */
+static void treeDependencies(long i){
+    for(long child = 2*i+1; child <= 2*i+2 && child < targets; child++){
+        printf(" t%ld", child);
+    }
+}
+
+static struct Shape shapes[] = {
+    {"chain",   "one dependency path through every target", chainDependencies},
+    {"wide",    "all depends on every target, each a leaf", NULL},
+    {"fanout",  "every target depends on t0", fanoutDependencies},
+    {"diamond", "a chain of diamonds", diamondDependencies},
+    {"tree",    "a binary tree", treeDependencies},
+    {NULL, NULL, NULL}
+};
+
+/* Usage
+ * Prints how to run gengraph and the shapes it knows, then exits.
+ */
+static void usage(){
+    fprintf(stderr, "usage: gengraph [-n targets] [-s shape] [-l length] [-v vars]\n");
+    for(struct Shape *shape = shapes; shape->name != NULL; shape++){
+        fprintf(stderr, "  %-8s %s\n", shape->name, shape->description);
+    }
+    exit(1);
+}
+
+/* Main entry point.
+ * argc    A count of command-line arguments
+ * argv    The command-line argument values
+ *
+ * Writes the variables, then all (depending on the roots of the
+ * shape), then each target with its dependencies and rules. Every
+ * target's rule touches its own file, so a full build is cheap and a
+ * second build has nothing to do.
+ */
+int main(int argc, char *argv[]){
+    struct Shape *shape = &shapes[0];
+    int opt;
+    while((opt = getopt(argc, argv, "n:s:l:v:")) != -1){
+        switch(opt){
+            case 'n':
+                targets = atol(optarg);
+                break;
+            case 's':
+                shape = shapes;
+                while(shape->name != NULL && strcmp(shape->name, optarg) != 0){
+                    shape++;
+                }
+                if(shape->name == NULL){
+                    usage();
+                }
+                break;
+            case 'l':
+                lineLength = atol(optarg);
+                break;
+            case 'v':
+                variables = atol(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    if(targets < 1){
+        usage();
+    }
+
+    printf("# gengraph -n %ld -s %s -l %ld -v %ld\n", targets, shape->name, lineLength, variables);
+    for(long i = 0; i < variables; i++){
+        if(i == 0){
+            printf("VAR0=value0\n");
+        } else {
+            printf("VAR%ld=${VAR%ld} value%ld\n", i, i-1, i);
+        }
+    }
+
+    printf("all:");
+    if(strcmp(shape->name, "wide") == 0 || strcmp(shape->name, "fanout") == 0){
+        for(long i = 0; i < targets; i++){
+            printf(" t%ld", i);
+        }
+    } else {
+        printf(" t0");
+    }
+    printf("\n\ttouch all\n");
+
+    char *padding = malloc(lineLength+1);
+    memset(padding, 'x', lineLength);
+    padding[lineLength] = '\0';
+    for(long i = 0; i < targets; i++){
+        printf("t%ld:", i);
+        if(shape->dependencies != NULL){
+            shape->dependencies(i);
+        }
+        printf("\n\ttouch t%ld\n", i);
+        if(lineLength > 0 || (variables > 0 && i%2 == 0)){
+            printf("\techo %s", padding);
+            if(variables > 0 && i%2 == 0){
+                printf(" ${VAR%ld}", variables-1);
+            }
+            printf(" > /dev/null\n");
+        }
+    }
+    free(padding);
+    return 0;
+}
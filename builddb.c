@@ -0,0 +1,468 @@
+/*
+ *  CS347 builddb.c
+ *  
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h> 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "target.h"
+#include "statcache.h"
+#include "builddb.h"
+
+/* CONSTANTS */
+
+#define DB_BUCKETS 4096
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Database File Structure
+ *
+ * The digest of one file together with the mtime, size and inode it
+ * had when it was hashed, and when that was: the file clock just 
+ * before the file was read, or, for a record loaded from the database,
+ * when the database was written.
+ */
+struct DbFile {
+    char *path;
+    unsigned long hash;
+
+    long long mtime;
+    long long size;
+    unsigned long long inode;
+    unsigned long long digest;
+    long long hashed;
+
+    struct DbFile *next;
+};
+
+/* Database Target Structure
+ *
+ * What a target looked like the last time it was brought up to date:
+ * the digest of its expanded rules, of its output and of each input.
+ */
+struct DbTarget {
+    char *name;
+    unsigned long hash;
+
+    unsigned long long rules;
+    unsigned long long output;
+
+    int inputCount;
+    char **inputs;
+    unsigned long long *digests;
+
+    struct DbTarget *next;
+};
+
+static struct DbFile *files[DB_BUCKETS];
+static struct DbTarget *targets[DB_BUCKETS];
+
+/* Racily Clean
+ * record   A file record.
+ *
+ * A file can be written again within the same clock tick it was 
+ * hashed in, keeping its mtime (and its size). Such a change is only 
+ * ruled out for a file whose mtime is strictly older than the time it 
+ * was hashed; any other record cannot be trusted on its stat data.
+ */
+static int racilyClean(struct DbFile *record){
+    return record->mtime >= record->hashed;
+}
+
+static unsigned long long rotl64(unsigned long long x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+static unsigned long long read64(const unsigned char *p){
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int read32(const unsigned char *p){
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned long long xxhRound(unsigned long long acc, unsigned long long input){
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static unsigned long long xxhMerge(unsigned long long acc, unsigned long long val){
+    acc ^= xxhRound(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/* Digest Bytes
+ * data     The bytes to hash.
+ * len      The number of bytes.
+ * seed     A starting value, so digests can be chained.
+ *
+ * XXH64: 32-byte stripes are folded into four accumulators, then the 
+ * tail is mixed in 8, 4 and 1 bytes at a time and the result avalanched.
+ */
+unsigned long long digestBytes(const void *data, size_t len, unsigned long long seed){
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    unsigned long long h;
+
+    if(len >= 32){
+        unsigned long long v1 = seed + PRIME64_1 + PRIME64_2;
+        unsigned long long v2 = seed + PRIME64_2;
+        unsigned long long v3 = seed;
+        unsigned long long v4 = seed - PRIME64_1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxhRound(v1, read64(p));
+            v2 = xxhRound(v2, read64(p+8));
+            v3 = xxhRound(v3, read64(p+16));
+            v4 = xxhRound(v4, read64(p+24));
+            p += 32;
+        } while(p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxhMerge(h, v1);
+        h = xxhMerge(h, v2);
+        h = xxhMerge(h, v3);
+        h = xxhMerge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += len;
+
+    while(p + 8 <= end){
+        h ^= xxhRound(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if(p + 4 <= end){
+        h ^= (unsigned long long)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while(p < end){
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* Find File Record
+ * path     The file to look up.
+ *
+ * Returns the record for path, adding an empty one if needed.
+ */
+static struct DbFile *findFileRecord(const char *path){
+    unsigned long hash = hashName(path);
+    struct DbFile *current = files[hash % DB_BUCKETS];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->path, path) == 0){
+            return current;
+        }
+        current = current->next;
+    }
+    current = calloc(1, sizeof(struct DbFile));
+    current->path = malloc(strlen(path)+1);
+    strcpy(current->path, path);
+    current->hash = hash;
+    current->next = files[hash % DB_BUCKETS];
+    files[hash % DB_BUCKETS] = current;
+    return current;
+}
+
+/* Find Target Record
+ * name     The target to look up.
+ * create   Whether to add an empty record if there is none.
+ *
+ * Returns the record for name, or NULL.
+ */
+static struct DbTarget *findTargetRecord(const char *name, int create){
+    unsigned long hash = hashName(name);
+    struct DbTarget *current = targets[hash % DB_BUCKETS];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->name, name) == 0){
+            return current;
+        }
+        current = current->next;
+    }
+    if(!create){
+        return NULL;
+    }
+    current = calloc(1, sizeof(struct DbTarget));
+    current->name = malloc(strlen(name)+1);
+    strcpy(current->name, name);
+    current->hash = hash;
+    current->next = targets[hash % DB_BUCKETS];
+    targets[hash % DB_BUCKETS] = current;
+    return current;
+}
+
+/* Hash File
+ * path     The file to read.
+ *
+ * Maps the file and hashes its contents. Anything that is not a 
+ * regular file (a directory, say) is digested by its mtime instead.
+ * Returns 0 if the file cannot be opened.
+ */
+static unsigned long long hashFile(const char *path){
+    int fd = open(path, O_RDONLY);
+    if(fd == -1){
+        return 0;
+    }
+    struct stat fileStat;
+    unsigned long long digest = 0;
+    if(fstat(fd, &fileStat) == 0){
+        if(!S_ISREG(fileStat.st_mode)){
+            long long mtime = (long long)fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec;
+            digest = digestBytes(&mtime, sizeof(mtime), 0);
+        } else if(fileStat.st_size == 0){
+            digest = digestBytes("", 0, 0);
+        } else {
+            void *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(data != MAP_FAILED){
+                madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+                digest = digestBytes(data, fileStat.st_size, 0);
+                munmap(data, fileStat.st_size);
+            }
+        }
+    }
+    close(fd);
+    if(digest == 0){
+        digest = 1;
+    }
+    return digest;
+}
+
+/* File Digest
+ * path     The file to hash.
+ *
+ * Uses the stat cache to decide whether the recorded digest can be
+ * trusted, hashing the file only when its metadata changed or the 
+ * record is racily clean.
+ */
+unsigned long long fileDigest(const char *path){
+    struct FileInfo *info = statFile(path);
+    if(!info->exists){
+        return 0;
+    }
+    struct DbFile *record = findFileRecord(path);
+    if(record->digest != 0 && record->mtime == info->mtime && record->size == (long long)info->size
+            && record->inode == (unsigned long long)info->inode && !racilyClean(record)){
+        return record->digest;
+    }
+    record->hashed = fileClock();
+    record->digest = hashFile(path);
+    record->mtime = info->mtime;
+    record->size = info->size;
+    record->inode = info->inode;
+    return record->digest;
+}
+
+/* Load Build Database
+ * path     The database file.
+ *
+ * The file is plain text, one record per line:
+ *   F <digest> <mtime> <size> <inode> <path>
+ *   T <rules> <output> <inputs> <name>
+ *   I <digest> <path>          (one per input, after its T line)
+ * File records count as hashed when the database was written, its 
+ * mtime (see racilyClean).
+ */
+void loadBuildDb(const char *path){
+    FILE *db = fopen(path, "r");
+    if(db == NULL){
+        return;
+    }
+    struct stat dbStat;
+    long long written = 0;
+    if(fstat(fileno(db), &dbStat) == 0){
+        written = (long long)dbStat.st_mtim.tv_sec * 1000000000LL + dbStat.st_mtim.tv_nsec;
+    }
+    size_t  bufsize = 0;
+    char*   line    = NULL;
+    ssize_t linelen;
+    struct DbTarget *current = NULL;
+    int input = 0;
+    while((linelen = getline(&line, &bufsize, db)) != -1){
+        if(linelen > 0 && line[linelen-1] == '\n'){
+            line[linelen-1] = '\0';
+        }
+        unsigned long long digest, output, inode;
+        long long mtime, size;
+        int count, offset = 0;
+        if(sscanf(line, "F %llx %lld %lld %llu %n", &digest, &mtime, &size, &inode, &offset) == 4 && offset > 0){
+            struct DbFile *record = findFileRecord(&line[offset]);
+            record->digest = digest;
+            record->mtime = mtime;
+            record->size = size;
+            record->inode = inode;
+            record->hashed = written;
+        } else if(sscanf(line, "T %llx %llx %d %n", &digest, &output, &count, &offset) == 3 && offset > 0 && count >= 0){
+            current = findTargetRecord(&line[offset], 1);
+            current->rules = digest;
+            current->output = output;
+            current->inputCount = count;
+            current->inputs = calloc(count+1, sizeof(char *));
+            current->digests = calloc(count+1, sizeof(unsigned long long));
+            input = 0;
+        } else if(sscanf(line, "I %llx %n", &digest, &offset) == 1 && offset > 0 
+                && current != NULL && input < current->inputCount){
+            current->inputs[input] = malloc(strlen(&line[offset])+1);
+            strcpy(current->inputs[input], &line[offset]);
+            current->digests[input] = digest;
+            input++;
+        }
+    }
+    free(line);
+    fclose(db);
+}
+
+/* Save Build Database
+ * path     The database file.
+ *
+ * Writes the records in the format read by loadBuildDb. A racily 
+ * clean file record is written with an mtime of -1, which no file has,
+ * so the next run hashes the file again.
+ */
+int saveBuildDb(const char *path){
+    char temp[strlen(path)+5];
+    sprintf(temp, "%s.tmp", path);
+    FILE *db = fopen(temp, "w");
+    if(db == NULL){
+        perror(temp);
+        return -1;
+    }
+    for(int i = 0; i < DB_BUCKETS; i++){
+        for(struct DbFile *file = files[i]; file != NULL; file = file->next){
+            if(file->digest != 0){
+                fprintf(db, "F %llx %lld %lld %llu %s\n", file->digest, 
+                        racilyClean(file) ? -1 : file->mtime, file->size, file->inode, file->path);
+            }
+        }
+    }
+    for(int i = 0; i < DB_BUCKETS; i++){
+        for(struct DbTarget *target = targets[i]; target != NULL; target = target->next){
+            fprintf(db, "T %llx %llx %d %s\n", target->rules, target->output, target->inputCount, target->name);
+            for(int j = 0; j < target->inputCount; j++){
+                fprintf(db, "I %llx %s\n", target->digests[j], target->inputs[j] != NULL ? target->inputs[j] : "");
+            }
+        }
+    }
+    if(fclose(db) != 0 || rename(temp, path) != 0){
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/* Database Target Changed
+ * target   A target whose dependencies are up to date.
+ * rules    The digest of its expanded rule text.
+ *
+ * Inputs are compared by name and in order, so adding, removing or
+ * reordering dependencies also counts as a change.
+ */
+int dbTargetChanged(struct Target *target, unsigned long long rules){
+    struct DbTarget *record = findTargetRecord(target->targetName, 0);
+    if(record == NULL){
+        return -1;
+    }
+    if(record->rules != rules || record->inputCount != target->depCount){
+        return 1;
+    }
+    for(int i = 0; i < target->depCount; i++){
+        if(record->inputs[i] == NULL || strcmp(record->inputs[i], target->depNames[i]) != 0){
+            return 1;
+        }
+        unsigned long long digest = fileDigest(target->depNames[i]);
+        if(digest == 0 || digest != record->digests[i]){
+            return 1;
+        }
+    }
+    unsigned long long output = fileDigest(target->targetName);
+    if(output == 0 || output != record->output){
+        return 1;
+    }
+    return 0;
+}
+
+/* Free Inputs
+ * record   A target record.
+ *
+ * Frees the input list of record.
+ */
+static void freeInputs(struct DbTarget *record){
+    for(int i = 0; i < record->inputCount; i++){
+        free(record->inputs[i]);
+    }
+    free(record->inputs);
+    free(record->digests);
+    record->inputs = NULL;
+    record->digests = NULL;
+    record->inputCount = 0;
+}
+
+/* Database Record Target
+ * target   A target that has just been brought up to date.
+ * rules    The digest of its expanded rule text.
+ *
+ * Replaces whatever was recorded for target before.
+ */
+void dbRecordTarget(struct Target *target, unsigned long long rules){
+    struct DbTarget *record = findTargetRecord(target->targetName, 1);
+    freeInputs(record);
+    record->rules = rules;
+    record->output = fileDigest(target->targetName);
+    record->inputCount = target->depCount;
+    record->inputs = calloc(target->depCount+1, sizeof(char *));
+    record->digests = calloc(target->depCount+1, sizeof(unsigned long long));
+    for(int i = 0; i < target->depCount; i++){
+        record->inputs[i] = malloc(strlen(target->depNames[i])+1);
+        strcpy(record->inputs[i], target->depNames[i]);
+        record->digests[i] = fileDigest(target->depNames[i]);
+    }
+}
+
+/* Free Build Database
+ *
+ * Frees every file and target record.
+ */
+void freeBuildDb(){
+    for(int i = 0; i < DB_BUCKETS; i++){
+        struct DbFile *file = files[i];
+        while(file != NULL){
+            struct DbFile *next = file->next;
+            free(file->path);
+            free(file);
+            file = next;
+        }
+        files[i] = NULL;
+
+        struct DbTarget *target = targets[i];
+        while(target != NULL){
+            struct DbTarget *next = target->next;
+            freeInputs(target);
+            free(target->name);
+            free(target);
+            target = next;
+        }
+        targets[i] = NULL;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef __BUILDDB__H__
+#define __BUILDDB__H__
+/*
+ *  CS347 builddb.h
+ * 
+ */ 
+
+#include <stddef.h>
+#include "target.h"
+
+/* The build database kept in the working directory by --digests. */
+#define BUILD_DB ".umake.db"
+
+/* Digest Bytes
+ * data     The bytes to hash.
+ * len      The number of bytes.
+ * seed     A starting value, so digests can be chained.
+ *
+ * A 64-bit XXH64 hash of the bytes. The main loop works on four 
+ * independent lanes of 8 bytes, which keeps it fast on large files.
+ */
+unsigned long long digestBytes(const void *data, size_t len, unsigned long long seed);
+
+/* File Digest
+ * path     The file to hash.
+ *
+ * Returns the digest of the contents of path, or 0 if it does not 
+ * exist. Files are read through mmap, and a file whose mtime, size and
+ * inode match what the database last saw is not read at all, unless 
+ * its mtime is not older than when it was last hashed: it could have 
+ * been written again within the same clock tick.
+ */
+unsigned long long fileDigest(const char *path);
+
+/* Load Build Database
+ * path     The database file.
+ *
+ * Reads the file and target records of a previous run. A missing 
+ * file leaves the database empty.
+ */
+void loadBuildDb(const char *path);
+
+/* Save Build Database
+ * path     The database file.
+ *
+ * Writes every record to a temporary file and renames it over path.
+ * Returns 0 on success, -1 on failure.
+ */
+int saveBuildDb(const char *path);
+
+/* Database Target Changed
+ * target   A target whose dependencies are up to date.
+ * rules    The digest of its expanded rule text.
+ *
+ * Compares target with its record from the last run. Returns -1 if
+ * there is no record, 1 if the rules, the set or digests of its inputs
+ * or the digest of its output differ (or an input or the output is
+ * missing) and 0 if everything matches.
+ */
+int dbTargetChanged(struct Target *target, unsigned long long rules);
+
+/* Database Record Target
+ * target   A target that has just been brought up to date.
+ * rules    The digest of its expanded rule text.
+ *
+ * Stores the current digests of target's inputs and output.
+ */
+void dbRecordTarget(struct Target *target, unsigned long long rules);
+
+/* Free Build Database
+ *
+ * Frees every record held in memory.
+ */
+void freeBuildDb();
+
+#endif
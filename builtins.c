@@ -0,0 +1,542 @@
+/*
+ *  CS347 builtins.c
+ *  
+ */ 
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h> 
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include "builtins.h"
+
+/* CONSTANTS */
+
+#define DECLINE -1
+#define COPY_BUFFER 65536
+
+/* Builtin Structure
+ *
+ * A command umake can run itself. accepts returns 1 if the builtin
+ * handles the command line, or 0 if it has to be spawned; it may look
+ * at the files the line names but changes nothing. run is given the
+ * descriptors standing in for its standard output and standard error,
+ * in that order, and returns the exit status.
+ */
+struct Builtin {
+    const char *name;
+    int (*accepts)(char **args);
+    int (*run)(char **args, const int *fds);
+};
+
+/* Parse Flags
+ * args     The command line.
+ * allowed  The option letters the builtin understands.
+ * seen     Set to 1 for every letter given, indexed by the letter.
+ *
+ * Reads the options at the start of args. Returns the index of the
+ * first operand, or DECLINE if an option is not in allowed.
+ */
+static int parseFlags(char **args, const char *allowed, char *seen){
+    int i = 1;
+    for(; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++){
+        if(strcmp(args[i], "--") == 0){
+            return i+1;
+        }
+        for(char *c = &args[i][1]; *c != '\0'; c++){
+            if(strchr(allowed, *c) == NULL){
+                return DECLINE;
+            }
+            seen[(unsigned char)*c] = 1;
+        }
+    }
+    return i;
+}
+
+/* Write All
+ * fd       Where to write.
+ * data     The bytes to write.
+ * len      The number of bytes.
+ *
+ * Calls write until everything is written. Returns -1 on error.
+ */
+static int writeAll(int fd, const char *data, size_t len){
+    while(len > 0){
+        ssize_t written = write(fd, data, len);
+        if(written == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        len -= written;
+    }
+    return 0;
+}
+
+/* Echo Options
+ * args     The command line.
+ * newline  Set to 0 if -n is given.
+ *
+ * Leading words made only of n, e and E are options; -e (escapes) is
+ * left to the real echo. Returns the index of the first operand, or
+ * DECLINE.
+ */
+static int echoOptions(char **args, int *newline){
+    int i = 1;
+    *newline = 1;
+    if(args[1] != NULL && (strcmp(args[1], "--help") == 0 || strcmp(args[1], "--version") == 0)){
+        return DECLINE;
+    }
+    for(; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++){
+        if(strspn(&args[i][1], "neE") != strlen(&args[i][1])){
+            break;
+        }
+        if(strchr(args[i], 'e') != NULL){
+            return DECLINE;
+        }
+        if(strchr(args[i], 'n') != NULL){
+            *newline = 0;
+        }
+    }
+    return i;
+}
+
+static int echoAccepts(char **args){
+    int newline;
+    return echoOptions(args, &newline) != DECLINE;
+}
+
+/* Echo Builtin
+ * Prints its operands separated by spaces, like /bin/echo.
+ */
+static int echoBuiltin(char **args, const int *fds){
+    int newline;
+    int i = echoOptions(args, &newline);
+
+    size_t len = 0;
+    for(int j = i; args[j] != NULL; j++){
+        len += strlen(args[j]) + 1;
+    }
+    char *text = malloc(len+1);
+    size_t used = 0;
+    for(int j = i; args[j] != NULL; j++){
+        if(j > i){
+            text[used++] = ' ';
+        }
+        strcpy(&text[used], args[j]);
+        used += strlen(args[j]);
+    }
+    if(newline){
+        text[used++] = '\n';
+    }
+    int status = 0;
+    if(writeAll(fds[0], text, used) == -1){
+        dprintf(fds[1], "echo: write error: %s\n", strerror(errno));
+        status = 1;
+    }
+    free(text);
+    return status;
+}
+
+/* Touch, mkdir and rm take the options they know and at least one
+ * operand; rm -f alone does nothing and succeeds. */
+
+static int touchAccepts(char **args){
+    char seen[256] = {0};
+    int first = parseFlags(args, "", seen);
+    return first != DECLINE && args[first] != NULL;
+}
+
+static int mkdirAccepts(char **args){
+    char seen[256] = {0};
+    int first = parseFlags(args, "p", seen);
+    return first != DECLINE && args[first] != NULL;
+}
+
+static int rmAccepts(char **args){
+    char seen[256] = {0};
+    int first = parseFlags(args, "f", seen);
+    return first != DECLINE && (args[first] != NULL || seen['f']);
+}
+
+/* Touch Builtin
+ * Sets the times of each operand to now, creating missing files.
+ */
+static int touchBuiltin(char **args, const int *fds){
+    char seen[256] = {0};
+    int first = parseFlags(args, "", seen);
+    int status = 0;
+    for(int i = first; args[i] != NULL; i++){
+        if(utimensat(AT_FDCWD, args[i], NULL, 0) == 0){
+            continue;
+        }
+        int fd = -1;
+        if(errno == ENOENT){
+            fd = open(args[i], O_WRONLY | O_CREAT | O_NOCTTY | O_NONBLOCK, 0666);
+        }
+        if(fd == -1){
+            dprintf(fds[1], "touch: cannot touch '%s': %s\n", args[i], strerror(errno));
+            status = 1;
+        } else {
+            close(fd);
+        }
+    }
+    return status;
+}
+
+/* Make Parents
+ * path     A directory path.
+ *
+ * Creates every missing directory along path, like mkdir -p. 
+ * Returns -1 with errno set on failure.
+ */
+static int makeParents(const char *path){
+    char copy[strlen(path)+1];
+    strcpy(copy, path);
+    for(char *c = copy+1; ; c++){
+        if(*c == '/' || *c == '\0'){
+            char saved = *c;
+            *c = '\0';
+            if(mkdir(copy, 0777) == -1 && errno != EEXIST){
+                return -1;
+            }
+            *c = saved;
+            if(saved == '\0'){
+                break;
+            }
+        }
+    }
+    struct stat dirStat;
+    if(stat(path, &dirStat) == -1){
+        return -1;
+    }
+    if(!S_ISDIR(dirStat.st_mode)){
+        errno = ENOTDIR;
+        return -1;
+    }
+    return 0;
+}
+
+/* Mkdir Builtin
+ * Creates each operand; -p creates parents and accepts existing 
+ * directories.
+ */
+static int mkdirBuiltin(char **args, const int *fds){
+    char seen[256] = {0};
+    int first = parseFlags(args, "p", seen);
+    int status = 0;
+    for(int i = first; args[i] != NULL; i++){
+        int result = seen['p'] ? makeParents(args[i]) : mkdir(args[i], 0777);
+        if(result == -1){
+            dprintf(fds[1], "mkdir: cannot create directory '%s': %s\n", args[i], strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* Rm Builtin
+ * Removes each operand (not directories); -f ignores missing files.
+ */
+static int rmBuiltin(char **args, const int *fds){
+    char seen[256] = {0};
+    int first = parseFlags(args, "f", seen);
+    int status = 0;
+    for(int i = first; args[i] != NULL; i++){
+        if(unlink(args[i]) == -1 && !(seen['f'] && errno == ENOENT)){
+            dprintf(fds[1], "rm: cannot remove '%s': %s\n", args[i], strerror(errno));
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* Destination
+ * source   The file being moved or copied.
+ * dest     The last operand.
+ * path     A buffer of PATH_MAX bytes.
+ *
+ * Returns dest, or dest/basename(source) when dest is a directory.
+ */
+static const char *destination(const char *source, const char *dest, char *path){
+    struct stat destStat;
+    if(stat(dest, &destStat) == 0 && S_ISDIR(destStat.st_mode)){
+        char copy[strlen(source)+1];
+        strcpy(copy, source);
+        snprintf(path, 4096, "%s/%s", dest, basename(copy));
+        return path;
+    }
+    return dest;
+}
+
+/* Same Mount
+ * source   The file being moved.
+ * dest     Where it is moved to.
+ *
+ * rename() fails with EXDEV across mounts, even two mounts of the same
+ * file system, so the mount IDs of source and of dest's directory are
+ * compared, or their devices on kernels without mount IDs. Returns 1
+ * if either cannot be looked up, leaving rename() to report it.
+ */
+static int sameMount(const char *source, const char *dest){
+    char copy[strlen(dest)+1];
+    strcpy(copy, dest);
+    struct statx sourceStat;
+    struct statx dirStat;
+    if(statx(AT_FDCWD, source, AT_SYMLINK_NOFOLLOW, STATX_MNT_ID, &sourceStat) == -1
+            || statx(AT_FDCWD, dirname(copy), 0, STATX_MNT_ID, &dirStat) == -1){
+        return 1;
+    }
+    if((sourceStat.stx_mask & dirStat.stx_mask & STATX_MNT_ID) != 0){
+        return sourceStat.stx_mnt_id == dirStat.stx_mnt_id;
+    }
+    return sourceStat.stx_dev_major == dirStat.stx_dev_major
+        && sourceStat.stx_dev_minor == dirStat.stx_dev_minor;
+}
+
+/* Mv Accepts
+ * A single file renamed within one mount. Moves between mounts,
+ * several sources and -i onto an existing file are left to the real
+ * mv.
+ */
+static int mvAccepts(char **args){
+    char seen[256] = {0};
+    int first = parseFlags(args, "fi", seen);
+    if(first == DECLINE || args[first] == NULL || args[first+1] == NULL || args[first+2] != NULL){
+        return 0;
+    }
+    char path[4096];
+    const char *dest = destination(args[first], args[first+1], path);
+    struct stat destStat;
+    if(seen['i'] && lstat(dest, &destStat) == 0){
+        return 0;
+    }
+    return sameMount(args[first], dest);
+}
+
+/* Mv Builtin
+ * Renames a single file.
+ */
+static int mvBuiltin(char **args, const int *fds){
+    char seen[256] = {0};
+    int first = parseFlags(args, "fi", seen);
+    char path[4096];
+    const char *dest = destination(args[first], args[first+1], path);
+    if(rename(args[first], dest) == -1){
+        if(errno == ENOENT){
+            dprintf(fds[1], "mv: cannot stat '%s': %s\n", args[first], strerror(errno));
+        } else {
+            dprintf(fds[1], "mv: cannot move '%s' to '%s': %s\n", args[first], dest, strerror(errno));
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* Copy File
+ * source   The file to copy.
+ * dest     Where to copy it.
+ * preserve Whether to keep the mode, owner and times (-p).
+ * err      Where errors are reported.
+ *
+ * Copies one regular file. Returns 0 or 1 like cp.
+ */
+static int copyFile(const char *source, const char *dest, int preserve, int err){
+    int in = open(source, O_RDONLY);
+    if(in == -1){
+        dprintf(err, "cp: cannot open '%s' for reading: %s\n", source, strerror(errno));
+        return 1;
+    }
+    struct stat sourceStat;
+    fstat(in, &sourceStat);
+    int outFd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, sourceStat.st_mode & 0777);
+    if(outFd == -1){
+        dprintf(err, "cp: cannot create regular file '%s': %s\n", dest, strerror(errno));
+        close(in);
+        return 1;
+    }
+    int status = 0;
+    char *buffer = malloc(COPY_BUFFER);
+    ssize_t got;
+    while((got = read(in, buffer, COPY_BUFFER)) != 0){
+        if(got == -1){
+            if(errno == EINTR){
+                continue;
+            }
+            dprintf(err, "cp: error reading '%s': %s\n", source, strerror(errno));
+            status = 1;
+            break;
+        }
+        if(writeAll(outFd, buffer, got) == -1){
+            dprintf(err, "cp: error writing '%s': %s\n", dest, strerror(errno));
+            status = 1;
+            break;
+        }
+    }
+    free(buffer);
+    if(preserve && status == 0){
+        struct timespec times[2] = {sourceStat.st_atim, sourceStat.st_mtim};
+        if(fchown(outFd, sourceStat.st_uid, sourceStat.st_gid) == -1){
+            fchown(outFd, -1, sourceStat.st_gid);
+        }
+        fchmod(outFd, sourceStat.st_mode & 07777);
+        futimens(outFd, times);
+    }
+    if(close(outFd) == -1 && status == 0){
+        dprintf(err, "cp: error writing '%s': %s\n", dest, strerror(errno));
+        status = 1;
+    }
+    close(in);
+    return status;
+}
+
+/* Last Operand
+ * args     A command line.
+ * first    The index of its first operand.
+ *
+ * Returns the index of the last word of args.
+ */
+static int lastOperand(char **args, int first){
+    int last = first;
+    while(args[last+1] != NULL){
+        last++;
+    }
+    return last;
+}
+
+/* Cp Accepts
+ * Regular files, copied into a directory when there are several.
+ * Anything else (directories, special files, a file onto itself) is
+ * left to the real cp.
+ */
+static int cpAccepts(char **args){
+    char seen[256] = {0};
+    int first = parseFlags(args, "pf", seen);
+    if(first == DECLINE || args[first] == NULL || args[first+1] == NULL){
+        return 0;
+    }
+    int last = lastOperand(args, first);
+    struct stat destStat;
+    int destIsDir = stat(args[last], &destStat) == 0 && S_ISDIR(destStat.st_mode);
+    if(last - first > 1 && !destIsDir){
+        return 0;
+    }
+    char path[4096];
+    for(int i = first; i < last; i++){
+        struct stat sourceStat;
+        struct stat targetStat;
+        if(stat(args[i], &sourceStat) == -1 || !S_ISREG(sourceStat.st_mode)){
+            return 0;
+        }
+        const char *dest = destination(args[i], args[last], path);
+        if(stat(dest, &targetStat) == 0 && targetStat.st_dev == sourceStat.st_dev 
+                && targetStat.st_ino == sourceStat.st_ino){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Cp Builtin
+ * Copies each source to the last operand, or into it.
+ */
+static int cpBuiltin(char **args, const int *fds){
+    char seen[256] = {0};
+    int first = parseFlags(args, "pf", seen);
+    int last = lastOperand(args, first);
+    char path[4096];
+    int status = 0;
+    for(int i = first; i < last; i++){
+        status |= copyFile(args[i], destination(args[i], args[last], path), seen['p'], fds[1]);
+    }
+    return status;
+}
+
+static struct Builtin builtins[] = {
+    {"echo",  echoAccepts,  echoBuiltin},
+    {"touch", touchAccepts, touchBuiltin},
+    {"mv",    mvAccepts,    mvBuiltin},
+    {"cp",    cpAccepts,    cpBuiltin},
+    {"rm",    rmAccepts,    rmBuiltin},
+    {"mkdir", mkdirAccepts, mkdirBuiltin},
+    {NULL, NULL, NULL}
+};
+
+/* Find Builtin
+ * name     A command name.
+ *
+ * Returns the builtin called name, or NULL.
+ */
+static struct Builtin *findBuiltin(const char *name){
+    for(struct Builtin *builtin = builtins; builtin->name != NULL; builtin++){
+        if(strcmp(builtin->name, name) == 0){
+            return builtin;
+        }
+    }
+    return NULL;
+}
+
+/* Is Builtin
+ * name     A command name.
+ *
+ * Looks name up in the builtin table.
+ */
+int isBuiltin(const char *name){
+    return findBuiltin(name) != NULL;
+}
+
+/* Run Builtin
+ * args       A parsed command line, with its redirections removed.
+ * redirects  The redirections of the line.
+ * count      The number of redirections.
+ * output     The descriptor standing in for standard output.
+ * errors     The descriptor standing in for standard error.
+ * status     Set to the command's exit status when it is run.
+ *
+ * The builtin decides whether it takes the line before anything is
+ * opened, so a line left to the spawned command has its redirections
+ * opened (and truncated) only once, by the spawn. Then the
+ * redirections are opened the same way the spawned command's file
+ * actions would (the last one for each descriptor wins), so a missing
+ * input file fails the command just as it would fail the spawn. The 
+ * builtin writes its output to the redirected descriptor, or to output
+ * if there is none, and its diagnostics to errors.
+ */
+int runBuiltin(char **args, struct Redirect *redirects, int count, int output, int errors, int *status){
+    struct Builtin *builtin = findBuiltin(args[0]);
+    if(builtin == NULL || !builtin->accepts(args)){
+        return 0;
+    }
+
+    int fds[2] = {output, errors};
+    for(int i = 0; i < count; i++){
+        int fd = open(redirects[i].file, redirects[i].flags, 0644);
+        if(fd == -1){
+            dprintf(errors, "%s: %s\n", redirects[i].file, strerror(errno));
+            if(fds[0] != output){
+                close(fds[0]);
+            }
+            *status = 1;
+            return 1;
+        }
+        if(redirects[i].fd == 1){
+            if(fds[0] != output){
+                close(fds[0]);
+            }
+            fds[0] = fd;
+        } else {
+            close(fd);
+        }
+    }
+
+    *status = builtin->run(args, fds);
+    if(fds[0] != output){
+        close(fds[0]);
+    }
+    return 1;
+}
@@ -0,0 +1,36 @@
+#ifndef __BUILTINS__H__
+#define __BUILTINS__H__
+/*
+ *  CS347 builtins.h
+ * 
+ */ 
+
+#include "arg_parse.h"
+
+/* Run Builtin
+ * args       A parsed command line, with its redirections removed.
+ * redirects  The redirections of the line.
+ * count      The number of redirections.
+ * output     The descriptor standing in for standard output, normally 1.
+ * errors     The descriptor standing in for standard error, normally 2.
+ * status     Set to the command's exit status when it is run.
+ *
+ * Runs the common commands that show up in rules (echo, touch, mv, cp,
+ * rm and mkdir) inside umake instead of spawning a process for them. 
+ * Only the options umake implements itself are accepted; for anything
+ * else, or a case the real command handles differently (such as mv -i 
+ * onto an existing file), nothing is done and the command is spawned 
+ * as usual.
+ *
+ * Returns 1 if the command was run, 0 if it has to be spawned.
+ */
+int runBuiltin(char **args, struct Redirect *redirects, int count, int output, int errors, int *status);
+
+/* Is Builtin
+ * name     A command name.
+ *
+ * Returns 1 if runBuiltin may run a command called name.
+ */
+int isBuiltin(const char *name);
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ *  CS347 command.c
+ *  
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> 
+#include "arena.h"
+#include "arg_parse.h"
+#include "builtins.h"
+#include "command.h"
+#include "variables.h"
+
+/* Has Vars
+ * text     A word.
+ *
+ * Returns 1 if the word holds the start of a variable reference.
+ */
+static int hasVars(const char *text){
+    return strstr(text, "${") != NULL;
+}
+
+/* Is Operator
+ * text     A word.
+ *
+ * Returns 1 if the word is one of the redirections parseRedirections
+ * knows.
+ */
+static int isOperator(const char *text){
+    return strcmp(text, ">") == 0 || strcmp(text, ">>") == 0 || strcmp(text, "<") == 0;
+}
+
+/* Compile Command
+ * line     A rule line.
+ * arena    The arena the command is allocated from.
+ *
+ * The copy of line is split in place by arg_parse and then by 
+ * parseRedirections, so every word and file name points into
+ * command->text. The argument array arg_parse returns is copied
+ * into the arena (as argv, when there are no variables) and freed.
+ * parseRedirections drops the words after the first redirection that
+ * are not file names; if one of them has a variable, its value could
+ * hold a redirection, so the line is split late.
+ */
+struct Command *compileCommand(const char *line, struct Arena *arena){
+    struct Command *command = arenaAlloc(arena, sizeof(struct Command));
+    command->text = arenaCopy(arena, line);
+
+    int count = 0;
+    char **args = arg_parse(command->text, &count);
+    command->redirects = arenaAlloc(arena, (count+1)*sizeof(struct Redirect));
+    command->redirectCount = parseRedirections(args, command->redirects);
+    command->redirectFiles = arenaAlloc(arena, (command->redirectCount+1)*sizeof(struct Word));
+    command->words = arenaAlloc(arena, (count+1)*sizeof(struct Word));
+
+    int vars = 0;
+    while(args[command->wordCount] != NULL){
+        struct Word *word = &command->words[command->wordCount];
+        word->text = args[command->wordCount];
+        word->hasVars = hasVars(word->text);
+        vars |= word->hasVars;
+        command->wordCount++;
+    }
+    for(int i = 0; i < command->redirectCount; i++){
+        command->redirectFiles[i].text = command->redirects[i].file;
+        command->redirectFiles[i].hasVars = hasVars(command->redirects[i].file);
+        vars |= command->redirectFiles[i].hasVars;
+    }
+
+    for(int i = command->wordCount+1; i < count; i++){
+        int file = 0;
+        for(int j = 0; j < command->redirectCount; j++){
+            file |= args[i] == command->redirects[j].file;
+        }
+        if(!file && hasVars(args[i])){
+            command->lateSplit = 1;
+            vars = 1;
+        }
+    }
+
+    if(!vars){
+        command->argv = arenaAlloc(arena, (command->wordCount+1)*sizeof(char *));
+        memcpy(command->argv, args, command->wordCount*sizeof(char *));
+    } else {
+        command->line = arenaCopy(arena, line);
+    }
+    free(args);
+    command->builtin = command->wordCount > 0 && !command->words[0].hasVars 
+        && isBuiltin(command->words[0].text);
+    return command;
+}
+
+/* Expand Word
+ * word     A word with variables.
+ * inv      The invocation the expansion belongs to.
+ *
+ * Expands the word into a new string, kept in inv so that it is freed
+ * with it, and returns that string.
+ */
+static char *expandWord(struct Word *word, struct Invocation *inv){
+    char *result = expand(word->text);
+    inv->expanded[inv->expandedCount++] = result;
+    return result;
+}
+
+/* Split Line
+ * command  A compiled command with variables.
+ * inv      The invocation to fill in, owning nothing yet but expanded.
+ *
+ * Expands the whole line and splits it, the way umake did before rule
+ * lines were compiled. arg_parse's array becomes args.
+ */
+static int splitLine(struct Command *command, struct Invocation *inv){
+    char *line = expand(command->line);
+    inv->expanded[inv->expandedCount++] = line;
+    inv->args = arg_parse(line, &inv->argCount);
+    inv->redirects = malloc((inv->argCount+1)*sizeof(struct Redirect));
+    inv->redirectCount = parseRedirections(inv->args, inv->redirects);
+    inv->argCount = 0;
+    while(inv->args[inv->argCount] != NULL){
+        inv->argCount++;
+    }
+    return inv->argCount;
+}
+
+/* Instantiate Command
+ * command  A compiled command.
+ * inv      The invocation to fill in.
+ *
+ * A word that expands to several words (a variable holding "gcc -O2",
+ * say) becomes several arguments, and one that expands to nothing 
+ * disappears, just as if the whole line had been expanded and then
+ * split. A redirection file uses the first word of its expansion. A 
+ * <, > or >> among the expanded words would have been a redirection
+ * had the line been split after expanding, and a redirection file that
+ * expands to nothing would have taken the next word as its file, so in
+ * those cases (and for a line marked lateSplit) the words are dropped
+ * and splitLine starts over.
+ */
+int instantiateCommand(struct Command *command, struct Invocation *inv){
+    if(command->argv != NULL){
+        inv->args = command->argv;
+        inv->argCount = command->wordCount;
+        inv->redirects = command->redirects;
+        inv->redirectCount = command->redirectCount;
+        inv->expanded = NULL;
+        inv->expandedCount = 0;
+        inv->owned = 0;
+        return inv->argCount;
+    }
+
+    inv->owned = 1;
+    inv->expanded = malloc((command->wordCount + command->redirectCount + 2)*sizeof(char *));
+    inv->expandedCount = 0;
+    if(command->lateSplit){
+        return splitLine(command, inv);
+    }
+
+    int cap = command->wordCount + 1;
+    int resplit = 0;
+    inv->args = malloc(cap*sizeof(char *));
+    inv->argCount = 0;
+    for(int i = 0; i < command->wordCount; i++){
+        struct Word *word = &command->words[i];
+        if(!word->hasVars){
+            inv->args[inv->argCount++] = word->text;
+            continue;
+        }
+        int pieces = 0;
+        char **split = arg_parse(expandWord(word, inv), &pieces);
+        int needed = inv->argCount + pieces + (command->wordCount - i - 1) + 1;
+        if(needed > cap){
+            cap = needed + command->wordCount;
+            inv->args = realloc(inv->args, cap*sizeof(char *));
+        }
+        for(int j = 0; j < pieces; j++){
+            resplit |= isOperator(split[j]);
+            inv->args[inv->argCount++] = split[j];
+        }
+        free(split);
+    }
+    inv->args[inv->argCount] = NULL;
+
+    inv->redirects = malloc((command->redirectCount+1)*sizeof(struct Redirect));
+    inv->redirectCount = 0;
+    for(int i = 0; i < command->redirectCount; i++){
+        struct Redirect *redirect = &inv->redirects[inv->redirectCount];
+        *redirect = command->redirects[i];
+        if(command->redirectFiles[i].hasVars){
+            int pieces = 0;
+            char **split = arg_parse(expandWord(&command->redirectFiles[i], inv), &pieces);
+            resplit |= pieces == 0;
+            for(int j = 0; j < pieces; j++){
+                resplit |= isOperator(split[j]);
+            }
+            redirect->file = split[0];
+            free(split);
+        }
+        if(redirect->file != NULL){
+            inv->redirectCount++;
+        }
+    }
+
+    if(resplit){
+        free(inv->args);
+        free(inv->redirects);
+        return splitLine(command, inv);
+    }
+    return inv->argCount;
+}
+
+/* Release Invocation
+ * inv      An invocation filled in by instantiateCommand.
+ *
+ * Only an invocation that needed expanding owns anything.
+ */
+void releaseInvocation(struct Invocation *inv){
+    if(!inv->owned){
+        return;
+    }
+    for(int i = 0; i < inv->expandedCount; i++){
+        free(inv->expanded[i]);
+    }
+    free(inv->expanded);
+    free(inv->args);
+    free(inv->redirects);
+    inv->owned = 0;
+}
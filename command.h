@@ -0,0 +1,96 @@
+#ifndef __COMMAND__H__
+#define __COMMAND__H__
+/*
+ *  CS347 command.h
+ * 
+ */ 
+
+#include "arena.h"
+#include "arg_parse.h"
+
+/* Word Structure
+ *
+ * One word of a compiled rule line. Words without variables are used
+ * as they are; a word holding a ${...} reference is expanded (and may
+ * split into several arguments) each time the command is run.
+ */
+struct Word {
+    char *text;
+    int hasVars;
+};
+
+/* Command Structure
+ *
+ * A rule line split up once, when it is added to its target: the 
+ * words of the command itself, the redirections (whose operators are
+ * already classified, and whose file names are words too) and whether
+ * the command is one of umake's builtins. argv is filled in ahead of
+ * time when no word has a variable. A line with variables also keeps
+ * its unsplit text in line, for instantiateCommand to fall back on, and
+ * lateSplit is set when it always has to: a word with a variable comes
+ * after the redirections, where splitting it once would have lost it.
+ */
+struct Command {
+    char *text;
+    char *line;
+    int lateSplit;
+
+    struct Word *words;
+    int wordCount;
+
+    struct Redirect *redirects;
+    struct Word *redirectFiles;
+    int redirectCount;
+
+    char **argv;
+    int builtin;
+};
+
+/* Invocation Structure
+ *
+ * A command with its variables expanded, ready to run. args and 
+ * redirects only need freeing (through releaseInvocation) when the
+ * command had variables.
+ */
+struct Invocation {
+    char **args;
+    int argCount;
+    struct Redirect *redirects;
+    int redirectCount;
+
+    char **expanded;
+    int expandedCount;
+    int owned;
+};
+
+/* Compile Command
+ * line     A rule line.
+ * arena    The arena the command is allocated from.
+ *
+ * Splits line into words the way arg_parse would, separates the 
+ * redirections from the command and notes which words need expanding.
+ * line is copied, so it may be freed or reused afterwards. The command
+ * lives as long as the arena.
+ */
+struct Command *compileCommand(const char *line, struct Arena *arena);
+
+/* Instantiate Command
+ * command  A compiled command.
+ * inv      The invocation to fill in.
+ *
+ * Expands the words that have variables. A command without variables
+ * is handed out as it is, with no work at all. The result is the same
+ * as expanding the whole line and then splitting it, including a <, >
+ * or >> that comes from a variable's value. Returns the number of
+ * arguments.
+ */
+int instantiateCommand(struct Command *command, struct Invocation *inv);
+
+/* Release Invocation
+ * inv      An invocation filled in by instantiateCommand.
+ *
+ * Frees what instantiateCommand allocated.
+ */
+void releaseInvocation(struct Invocation *inv);
+
+#endif
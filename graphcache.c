@@ -0,0 +1,356 @@
+/*
+ *  CS347 graphcache.c
+ *  
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h> 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "arena.h"
+#include "target.h"
+#include "builddb.h"
+#include "graphcache.h"
+#include "variables.h"
+
+/* CONSTANTS */
+
+#define GRAPH_MAGIC "UMKGRPH2"
+
+/* Graph Header Structure
+ *
+ * The start of a cache file. It is followed by the variables (pairs 
+ * of string offsets), the targets, the rules (string offsets), the
+ * dependency edges and finally the string table. Every section is a 
+ * multiple of 4 bytes long, so each one is aligned in the mapping.
+ */
+struct GraphHeader {
+    char magic[8];
+    unsigned long long makefileSize;
+    unsigned long long makefileDigest;
+
+    unsigned int varCount;
+    unsigned int targetCount;
+    unsigned int ruleCount;
+    unsigned int depCount;
+    unsigned int stringSize;
+    unsigned int unused;
+};
+
+/* Cached Target Structure
+ *
+ * A target as stored in the cache: offsets of its strings, the 
+ * ranges of its rules and dependency edges and its resource weights.
+ */
+struct CachedTarget {
+    unsigned int name;
+    unsigned int dependencies;
+    unsigned int firstRule;
+    unsigned int ruleCount;
+    unsigned int firstDep;
+    unsigned int depCount;
+    unsigned int jobWeight;
+    unsigned int memWeight;
+};
+
+/* Cached Dependency Structure
+ *
+ * One dependency edge: the offset of its name and the index of the 
+ * target it refers to, or -1 for a plain file.
+ */
+struct CachedDep {
+    unsigned int name;
+    int target;
+};
+
+/* String Table Structure
+ *
+ * A growable buffer the strings are collected in while saving.
+ */
+struct StringTable {
+    char *data;
+    unsigned int size;
+    unsigned int cap;
+};
+
+static void *mapping = NULL;
+static size_t mappingSize = 0;
+
+static unsigned long long makefileDigest = 0;
+static unsigned long long makefileSize = 0;
+static int makefileRead = 0;
+
+static char **variables = NULL;
+static int variableCount = 0;
+static int variableCap = 0;
+
+/* Digest Makefile
+ * makefile The makefile to hash.
+ *
+ * Records the size and digest of the makefile. This happens before it
+ * is parsed, so a cache written later describes the parsed contents.
+ * Returns -1 if the makefile cannot be read.
+ */
+static int digestMakefile(const char *makefile){
+    int fd = open(makefile, O_RDONLY);
+    if(fd == -1){
+        return -1;
+    }
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0){
+        close(fd);
+        return -1;
+    }
+    makefileSize = fileStat.st_size;
+    makefileDigest = digestBytes("", 0, 0);
+    if(fileStat.st_size > 0){
+        void *data = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED){
+            close(fd);
+            return -1;
+        }
+        makefileDigest = digestBytes(data, fileStat.st_size, 0);
+        munmap(data, fileStat.st_size);
+    }
+    close(fd);
+    makefileRead = 1;
+    return 0;
+}
+
+/* Load Graph Cache
+ * cache    The graph cache file.
+ * makefile The makefile the cache was made from.
+ * head     An empty target list to fill in.
+ *
+ * Every offset and index in the file is checked against the section 
+ * sizes before anything is built, so a truncated or corrupt cache is 
+ * simply ignored.
+ */
+int loadGraphCache(const char *cache, const char *makefile, struct Target *head){
+    if(digestMakefile(makefile) != 0){
+        return 0;
+    }
+    int fd = open(cache, O_RDONLY);
+    if(fd == -1){
+        return 0;
+    }
+    struct stat cacheStat;
+    if(fstat(fd, &cacheStat) != 0 || cacheStat.st_size < (off_t)sizeof(struct GraphHeader)){
+        close(fd);
+        return 0;
+    }
+    void *data = mmap(NULL, cacheStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+        return 0;
+    }
+
+    struct GraphHeader *header = data;
+    unsigned int *vars = (unsigned int *)(header + 1);
+    struct CachedTarget *targets = (struct CachedTarget *)(vars + 2*(size_t)header->varCount);
+    unsigned int *rules = (unsigned int *)(targets + header->targetCount);
+    struct CachedDep *deps = (struct CachedDep *)(rules + header->ruleCount);
+    char *strings = (char *)(deps + header->depCount);
+    size_t expected = sizeof(struct GraphHeader) + 2*sizeof(unsigned int)*(size_t)header->varCount
+        + sizeof(struct CachedTarget)*(size_t)header->targetCount + sizeof(unsigned int)*(size_t)header->ruleCount
+        + sizeof(struct CachedDep)*(size_t)header->depCount + header->stringSize;
+
+    int valid = memcmp(header->magic, GRAPH_MAGIC, 8) == 0 
+        && header->makefileSize == makefileSize && header->makefileDigest == makefileDigest
+        && expected == (size_t)cacheStat.st_size 
+        && header->stringSize > 0 && strings[header->stringSize-1] == '\0';
+    for(unsigned int i = 0; valid && i < 2*header->varCount; i++){
+        valid = vars[i] < header->stringSize;
+    }
+    for(unsigned int i = 0; valid && i < header->targetCount; i++){
+        valid = targets[i].name < header->stringSize && targets[i].dependencies < header->stringSize
+            && targets[i].firstRule + (unsigned long long)targets[i].ruleCount <= header->ruleCount
+            && targets[i].firstDep + (unsigned long long)targets[i].depCount <= header->depCount;
+    }
+    for(unsigned int i = 0; valid && i < header->ruleCount; i++){
+        valid = rules[i] < header->stringSize;
+    }
+    for(unsigned int i = 0; valid && i < header->depCount; i++){
+        valid = deps[i].name < header->stringSize && deps[i].target >= -1 
+            && deps[i].target < (int)header->targetCount;
+    }
+    if(!valid){
+        munmap(data, cacheStat.st_size);
+        return 0;
+    }
+    mapping = data;
+    mappingSize = cacheStat.st_size;
+
+    for(unsigned int i = 0; i < header->varCount; i++){
+        defineVariable(&strings[vars[2*i]], &strings[vars[2*i+1]]);
+    }
+
+    struct Target **byIndex = malloc((header->targetCount+1)*sizeof(struct Target *));
+    for(unsigned int i = 0; i < header->targetCount; i++){
+        byIndex[i] = appendTarget(head, &strings[targets[i].name], &strings[targets[i].dependencies]);
+        byIndex[i]->jobWeight = targets[i].jobWeight > 0 ? targets[i].jobWeight : 1;
+        byIndex[i]->memWeight = targets[i].memWeight;
+        for(unsigned int j = 0; j < targets[i].ruleCount; j++){
+            appendRule(head, byIndex[i], &strings[rules[targets[i].firstRule + j]]);
+        }
+    }
+    for(unsigned int i = 0; i < header->targetCount; i++){
+        int count = targets[i].depCount;
+        char **names = arenaAlloc(targetArena(head), (count+1)*sizeof(char *));
+        struct Target **depTargets = arenaAlloc(targetArena(head), (count+1)*sizeof(struct Target *));
+        for(int j = 0; j < count; j++){
+            struct CachedDep *dep = &deps[targets[i].firstDep + j];
+            names[j] = &strings[dep->name];
+            depTargets[j] = dep->target == -1 ? NULL : byIndex[dep->target];
+        }
+        names[count] = NULL;
+        setDependencies(head, byIndex[i], names, depTargets, count);
+    }
+    free(byIndex);
+    return 1;
+}
+
+/* Cache Variable
+ * name     A variable set by the makefile.
+ * value    Its value.
+ *
+ * Copies the pair into the list of variables.
+ */
+void cacheVariable(const char *name, const char *value){
+    if(variableCount+2 > variableCap){
+        variableCap = variableCap == 0 ? 16 : variableCap*2;
+        variables = realloc(variables, variableCap*sizeof(char *));
+    }
+    variables[variableCount] = malloc(strlen(name)+1);
+    strcpy(variables[variableCount++], name);
+    variables[variableCount] = malloc(strlen(value)+1);
+    strcpy(variables[variableCount++], value);
+}
+
+/* Add String
+ * table    The string table being built.
+ * string   The string to add.
+ *
+ * Appends string (with its terminator) and returns its offset.
+ */
+static unsigned int addString(struct StringTable *table, const char *string){
+    unsigned int len = strlen(string)+1;
+    while(table->size + len > table->cap){
+        table->cap = table->cap == 0 ? 4096 : table->cap*2;
+        table->data = realloc(table->data, table->cap);
+    }
+    memcpy(&table->data[table->size], string, len);
+    table->size += len;
+    return table->size - len;
+}
+
+/* Save Graph Cache
+ * cache    The graph cache file.
+ * makefile The makefile head was parsed from.
+ * head     The parsed target list, after buildGraph.
+ *
+ * Builds each section in memory, then writes them through a 
+ * temporary file that is renamed over cache.
+ */
+int saveGraphCache(const char *cache, const char *makefile, struct Target *head){
+    if(!makefileRead && digestMakefile(makefile) != 0){
+        return -1;
+    }
+    struct GraphHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_MAGIC, 8);
+    header.makefileSize = makefileSize;
+    header.makefileDigest = makefileDigest;
+    header.varCount = variableCount/2;
+    header.targetCount = countTargets(head);
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        for(struct Rules *r = current->ruleList; r != NULL; r = r->next){
+            if(r->rulesList != NULL){
+                header.ruleCount++;
+            }
+        }
+        header.depCount += current->depCount;
+    }
+
+    struct StringTable table = {NULL, 0, 0};
+    unsigned int *vars = malloc((2*header.varCount+1)*sizeof(unsigned int));
+    struct CachedTarget *targets = malloc((header.targetCount+1)*sizeof(struct CachedTarget));
+    unsigned int *rules = malloc((header.ruleCount+1)*sizeof(unsigned int));
+    struct CachedDep *deps = malloc((header.depCount+1)*sizeof(struct CachedDep));
+
+    for(int i = 0; i < variableCount; i++){
+        vars[i] = addString(&table, variables[i]);
+    }
+    unsigned int rule = 0;
+    unsigned int dep = 0;
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        struct CachedTarget *target = &targets[current->id];
+        target->name = addString(&table, current->targetName);
+        target->dependencies = addString(&table, current->dependencies != NULL ? current->dependencies : "");
+        target->jobWeight = current->jobWeight;
+        target->memWeight = current->memWeight;
+        target->firstRule = rule;
+        for(struct Rules *r = current->ruleList; r != NULL; r = r->next){
+            if(r->rulesList != NULL){
+                rules[rule++] = addString(&table, r->rulesList);
+            }
+        }
+        target->ruleCount = rule - target->firstRule;
+        target->firstDep = dep;
+        for(int i = 0; i < current->depCount; i++){
+            deps[dep].name = addString(&table, current->depNames[i]);
+            deps[dep].target = current->depTargets[i] != NULL ? current->depTargets[i]->id : -1;
+            dep++;
+        }
+        target->depCount = dep - target->firstDep;
+    }
+    while(table.size % 4 != 0 || table.size == 0){
+        addString(&table, "");
+    }
+    header.stringSize = table.size;
+
+    char temp[strlen(cache)+5];
+    sprintf(temp, "%s.tmp", cache);
+    FILE *out = fopen(temp, "w");
+    int result = -1;
+    if(out != NULL){
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(vars, sizeof(unsigned int), 2*header.varCount, out);
+        fwrite(targets, sizeof(struct CachedTarget), header.targetCount, out);
+        fwrite(rules, sizeof(unsigned int), header.ruleCount, out);
+        fwrite(deps, sizeof(struct CachedDep), header.depCount, out);
+        fwrite(table.data, 1, table.size, out);
+        if(fclose(out) == 0 && rename(temp, cache) == 0){
+            result = 0;
+        } else {
+            unlink(temp);
+        }
+    }
+    free(vars);
+    free(targets);
+    free(rules);
+    free(deps);
+    free(table.data);
+    return result;
+}
+
+/* Close Graph Cache
+ *
+ * Releases the mapping and the variable list.
+ */
+void closeGraphCache(){
+    if(mapping != NULL){
+        munmap(mapping, mappingSize);
+        mapping = NULL;
+    }
+    for(int i = 0; i < variableCount; i++){
+        free(variables[i]);
+    }
+    free(variables);
+    variables = NULL;
+    variableCount = 0;
+    variableCap = 0;
+    makefileRead = 0;
+}
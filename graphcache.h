@@ -0,0 +1,52 @@
+#ifndef __GRAPHCACHE__H__
+#define __GRAPHCACHE__H__
+/*
+ *  CS347 graphcache.h
+ * 
+ */ 
+
+#include "target.h"
+
+/* The precompiled graph kept next to the uMakefile. */
+#define GRAPH_CACHE ".umake.graph"
+
+/* Load Graph Cache
+ * cache    The graph cache file.
+ * makefile The makefile the cache was made from.
+ * head     An empty target list to fill in.
+ *
+ * Maps the cache and, if it was made from a makefile with the same 
+ * size and digest as makefile, appends its targets and rules to head 
+ * (their strings point into the mapping, nothing is copied), links 
+ * the dependency edges from their stored indices and defines its 
+ * variables (see variables.h). Returns 1 if the graph was loaded,
+ * 0 if the makefile has to be parsed.
+ */
+int loadGraphCache(const char *cache, const char *makefile, struct Target *head);
+
+/* Cache Variable
+ * name     A variable set by the makefile.
+ * value    Its value.
+ *
+ * Remembers a variable assignment, in order, for saveGraphCache.
+ */
+void cacheVariable(const char *name, const char *value);
+
+/* Save Graph Cache
+ * cache    The graph cache file.
+ * makefile The makefile head was parsed from.
+ * head     The parsed target list, after buildGraph.
+ *
+ * Writes the targets, rules, dependency edges (as target indices) and
+ * variables to cache. Returns 0 on success, -1 on failure.
+ */
+int saveGraphCache(const char *cache, const char *makefile, struct Target *head);
+
+/* Close Graph Cache
+ *
+ * Unmaps a loaded cache and forgets the cached variables. Must only be 
+ * called once the targets that point into the cache are no longer used.
+ */
+void closeGraphCache();
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ *  CS347 history.c
+ *  
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> 
+#include "target.h"
+#include "history.h"
+
+/* CONSTANTS */
+
+/* The number of buckets the history starts with; it doubles whenever 
+ * it holds more records than buckets. */
+#define HISTORY_BUCKETS 1024
+
+/* Duration Structure
+ *
+ * How long one target's rules took the last time they ran (-1 if they
+ * have not been timed). When those rules left the target's file as it
+ * was, stamp is the file's modification time they left behind, built 
+ * when the target counts as built and changed when its contents last 
+ * changed; stamp is 0 otherwise.
+ */
+struct Duration {
+    char *name;
+    unsigned long hash;
+    long long duration;
+    long long stamp;
+    long long built;
+    long long changed;
+    struct Duration *next;
+};
+
+/* The history: bucketCount buckets (a power of two) of Duration chains,
+ * holding recordCount records. timedCount of them have a duration, and
+ * those add up to totalDuration; stampCount have a stamp. dirty is set
+ * once anything has been recorded in this run. */
+static struct Duration **buckets = NULL;
+static unsigned long bucketCount = 0;
+static unsigned long recordCount = 0;
+static unsigned long timedCount = 0;
+static unsigned long stampCount = 0;
+static long long totalDuration = 0;
+static int dirty = 0;
+
+/* Grow Buckets
+ *
+ * Allocates the first HISTORY_BUCKETS buckets, or doubles the table 
+ * and moves every record to its new bucket.
+ */
+static void growBuckets(){
+    unsigned long newCount = bucketCount == 0 ? HISTORY_BUCKETS : 2 * bucketCount;
+    struct Duration **newBuckets = calloc(newCount, sizeof(struct Duration *));
+    for(unsigned long i = 0; i < bucketCount; i++){
+        struct Duration *current = buckets[i];
+        while(current != NULL){
+            struct Duration *next = current->next;
+            current->next = newBuckets[current->hash & (newCount - 1)];
+            newBuckets[current->hash & (newCount - 1)] = current;
+            current = next;
+        }
+    }
+    free(buckets);
+    buckets = newBuckets;
+    bucketCount = newCount;
+}
+
+/* Find Duration
+ * name     The target to look up.
+ * create   Whether to add a record (with no duration and no stamp) if
+ *          there is none.
+ *
+ * Returns the record for name, or NULL.
+ */
+static struct Duration *findDuration(const char *name, int create){
+    if(bucketCount == 0){
+        if(!create){
+            return NULL;
+        }
+        growBuckets();
+    }
+    unsigned long hash = hashName(name);
+    struct Duration *current = buckets[hash & (bucketCount - 1)];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->name, name) == 0){
+            return current;
+        }
+        current = current->next;
+    }
+    if(!create){
+        return NULL;
+    }
+    if(recordCount >= bucketCount){
+        growBuckets();
+    }
+    current = calloc(1, sizeof(struct Duration));
+    current->name = malloc(strlen(name)+1);
+    strcpy(current->name, name);
+    current->hash = hash;
+    current->duration = -1;
+    current->next = buckets[hash & (bucketCount - 1)];
+    buckets[hash & (bucketCount - 1)] = current;
+    recordCount++;
+    return current;
+}
+
+/* Set Duration
+ * name     A target name.
+ * duration Its duration in nanoseconds.
+ *
+ * Stores duration for name, keeping timedCount and totalDuration up to
+ * date.
+ */
+static void setDuration(const char *name, long long duration){
+    struct Duration *record = findDuration(name, 1);
+    if(record->duration == -1){
+        timedCount++;
+        record->duration = 0;
+    }
+    totalDuration += duration - record->duration;
+    record->duration = duration;
+}
+
+/* Set Times
+ * name     A target name.
+ * stamp    Its file's modification time, or 0 to drop its times.
+ * built    When it counts as built.
+ * changed  When its contents last changed.
+ *
+ * Stores the times for name, keeping stampCount up to date.
+ */
+static void setTimes(const char *name, long long stamp, long long built, long long changed){
+    struct Duration *record = findDuration(name, stamp != 0);
+    if(record == NULL){
+        return;
+    }
+    stampCount += (stamp != 0) - (record->stamp != 0);
+    record->stamp = stamp;
+    record->built = built;
+    record->changed = changed;
+}
+
+/* Find Stamp
+ * name     A target name.
+ * mtime    Its file's modification time now.
+ *
+ * Returns the record for name if its stamp is mtime, that is if the 
+ * file has not been touched since its times were recorded, or NULL. 
+ * While no record has a stamp nothing is looked up.
+ */
+static struct Duration *findStamp(const char *name, long long mtime){
+    if(stampCount == 0){
+        return NULL;
+    }
+    struct Duration *record = findDuration(name, 0);
+    return record != NULL && record->stamp == mtime ? record : NULL;
+}
+
+/* Load History
+ * path     The history file.
+ *
+ * The file is plain text, one record per line:
+ *   D <nanoseconds> <name>
+ *   T <stamp> <built> <changed> <name>
+ */
+void loadHistory(const char *path){
+    FILE *history = fopen(path, "r");
+    if(history == NULL){
+        return;
+    }
+    size_t  bufsize = 0;
+    char*   line    = NULL;
+    ssize_t linelen;
+    while((linelen = getline(&line, &bufsize, history)) != -1){
+        if(linelen > 0 && line[linelen-1] == '\n'){
+            line[linelen-1] = '\0';
+        }
+        long long duration, stamp, built, changed;
+        int offset = 0;
+        if(sscanf(line, "D %lld %n", &duration, &offset) == 1 && offset > 0 && duration >= 0){
+            setDuration(&line[offset], duration);
+        } else if(sscanf(line, "T %lld %lld %lld %n", &stamp, &built, &changed, &offset) == 3 
+                && offset > 0 && stamp != 0){
+            setTimes(&line[offset], stamp, built, changed);
+        }
+    }
+    free(line);
+    fclose(history);
+}
+
+/* Save History
+ * path     The history file.
+ *
+ * Writes the records in the format read by loadHistory.
+ */
+int saveHistory(const char *path){
+    if(!dirty){
+        return 0;
+    }
+    char temp[strlen(path)+5];
+    sprintf(temp, "%s.tmp", path);
+    FILE *history = fopen(temp, "w");
+    if(history == NULL){
+        perror(temp);
+        return -1;
+    }
+    for(unsigned long i = 0; i < bucketCount; i++){
+        for(struct Duration *record = buckets[i]; record != NULL; record = record->next){
+            if(record->duration != -1){
+                fprintf(history, "D %lld %s\n", record->duration, record->name);
+            }
+            if(record->stamp != 0){
+                fprintf(history, "T %lld %lld %lld %s\n", record->stamp, record->built, 
+                        record->changed, record->name);
+            }
+        }
+    }
+    if(fclose(history) != 0 || rename(temp, path) != 0){
+        perror(path);
+        return -1;
+    }
+    dirty = 0;
+    return 0;
+}
+
+/* Target Duration
+ * name     A target name.
+ */
+long long targetDuration(const char *name){
+    struct Duration *record = findDuration(name, 0);
+    return record != NULL ? record->duration : -1;
+}
+
+/* Average Duration
+ */
+long long averageDuration(){
+    return timedCount != 0 ? totalDuration / timedCount : 0;
+}
+
+/* Record Duration
+ * name     A target whose rules just ran.
+ * duration How long they took, in nanoseconds.
+ */
+void recordDuration(const char *name, long long duration){
+    setDuration(name, duration);
+    dirty = 1;
+}
+
+/* Built Time
+ * name     A target name.
+ * mtime    Its file's modification time now.
+ */
+long long builtTime(const char *name, long long mtime){
+    struct Duration *record = findStamp(name, mtime);
+    return record != NULL ? record->built : mtime;
+}
+
+/* Changed Time
+ * name     A target name.
+ * mtime    Its file's modification time now.
+ */
+long long changedTime(const char *name, long long mtime){
+    struct Duration *record = findStamp(name, mtime);
+    return record != NULL ? record->changed : mtime;
+}
+
+/* Record Times
+ * name     A target whose rules just ran.
+ * mtime    Its file's modification time now.
+ * built    When it counts as built.
+ * changed  When its contents last changed.
+ *
+ * Times that are all mtime need no record, so they drop the one name 
+ * had instead.
+ */
+void recordTimes(const char *name, long long mtime, long long built, long long changed){
+    if(built == mtime && changed == mtime){
+        setTimes(name, 0, 0, 0);
+    } else {
+        setTimes(name, mtime, built, changed);
+    }
+    dirty = 1;
+}
+
+/* Free History
+ *
+ * Frees every record and the buckets.
+ */
+void freeHistory(){
+    for(unsigned long i = 0; i < bucketCount; i++){
+        struct Duration *current = buckets[i];
+        while(current != NULL){
+            struct Duration *next = current->next;
+            free(current->name);
+            free(current);
+            current = next;
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+    bucketCount = 0;
+    recordCount = 0;
+    timedCount = 0;
+    stampCount = 0;
+    totalDuration = 0;
+    dirty = 0;
+}
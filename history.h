@@ -0,0 +1,92 @@
+#ifndef __HISTORY__H__
+#define __HISTORY__H__
+/*
+ *  CS347 history.h
+ * 
+ */ 
+
+/* The history kept in the working directory: how long each target's 
+ * rules took, and the times of targets whose rules left their file as 
+ * it was. */
+#define HISTORY_FILE ".umake.times"
+
+/* Load History
+ * path     The history file.
+ *
+ * Reads the durations and times recorded by earlier runs. A missing 
+ * file leaves the history empty.
+ */
+void loadHistory(const char *path);
+
+/* Save History
+ * path     The history file.
+ *
+ * Writes every record to a temporary file and renames it over path, 
+ * but only if something was recorded since the history was loaded.
+ * Returns 0 on success, -1 on failure.
+ */
+int saveHistory(const char *path);
+
+/* Target Duration
+ * name     A target name.
+ *
+ * Returns how long, in nanoseconds, the target's rules took the last
+ * time they ran, or -1 if they have never been timed.
+ */
+long long targetDuration(const char *name);
+
+/* Average Duration
+ *
+ * Returns the mean of every recorded duration, or 0 if there is none;
+ * the scheduler's estimate for targets that have never been timed.
+ */
+long long averageDuration();
+
+/* Record Duration
+ * name     A target whose rules just ran.
+ * duration How long they took, in nanoseconds.
+ *
+ * Replaces the duration recorded for name.
+ */
+void recordDuration(const char *name, long long duration);
+
+/* Built Time
+ * name     A target name.
+ * mtime    Its file's modification time now.
+ *
+ * Returns the time the target counts as built at: mtime, unless its 
+ * rules last ran without touching the file, in which case the time 
+ * they started. Compared with the times its dependencies changed.
+ */
+long long builtTime(const char *name, long long mtime);
+
+/* Changed Time
+ * name     A target name.
+ * mtime    Its file's modification time now.
+ *
+ * Returns the time the target's contents last changed: mtime, unless 
+ * its rules last ran and left the contents as they were, in which case
+ * the time from before. Targets depending on it compare this with 
+ * their own built time, so an output written again byte for byte does
+ * not make them rebuild.
+ */
+long long changedTime(const char *name, long long mtime);
+
+/* Record Times
+ * name     A target whose rules just ran.
+ * mtime    Its file's modification time now.
+ * built    When it counts as built.
+ * changed  When its contents last changed.
+ *
+ * Replaces the times recorded for name. They hold until the file's 
+ * modification time is no longer mtime.
+ */
+void recordTimes(const char *name, long long mtime, long long built, long long changed);
+
+/* Free History
+ *
+ * Frees every record held in memory.
+ */
+void freeHistory();
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ *  CS347 jobserver.c
+ *  
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h> 
+#include <errno.h>
+#include <fcntl.h>
+#include "jobserver.h"
+
+/* CONSTANTS */
+
+#define AUTH_OPTION "--jobserver-auth="
+#define FDS_OPTION "--jobserver-fds="
+#define FIFO_PREFIX "fifo:"
+
+/* The token umake writes into a pool it creates. */
+#define TOKEN '+'
+
+/* The jobserver umake takes its tokens from: readFd is umake's own, 
+ * non-blocking descriptor for the pool, writeFd where tokens go back.
+ * The tokens held are kept so that each one goes back as the byte it 
+ * came out as. */
+static int readFd = -1;
+static int writeFd = -1;
+static char *held = NULL;
+static int heldCount = 0;
+static int heldCap = 0;
+
+/* Open Private Reader
+ * path     A path opening the pool's read end: a FIFO, or 
+ *          /proc/self/fd/N for an inherited pipe.
+ *
+ * Opening the pipe again gives umake a file description of its own, 
+ * so making it non-blocking does not change the descriptor the other
+ * processes sharing the pool read from. Returns the descriptor or -1.
+ */
+static int openPrivateReader(const char *path){
+    return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+/* Join Pipe
+ * readEnd  The inherited read end.
+ * writeEnd The inherited write end.
+ *
+ * A parent make closes the descriptors for rules it does not consider 
+ * recursive, so they are checked before they are used.
+ */
+static int joinPipe(int readEnd, int writeEnd){
+    if(fcntl(readEnd, F_GETFD) == -1 || fcntl(writeEnd, F_GETFD) == -1){
+        fprintf(stderr, "umake: jobserver unavailable, running serially (mark the parent's rule with '+').\n");
+        return 0;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", readEnd);
+    readFd = openPrivateReader(path);
+    if(readFd == -1){
+        return 0;
+    }
+    writeFd = writeEnd;
+    return 1;
+}
+
+/* Join Fifo
+ * path     The named pipe of the pool.
+ */
+static int joinFifo(const char *path){
+    readFd = openPrivateReader(path);
+    if(readFd == -1){
+        fprintf(stderr, "umake: jobserver unavailable, running serially (%s).\n", strerror(errno));
+        return 0;
+    }
+    writeFd = open(path, O_WRONLY | O_CLOEXEC);
+    if(writeFd == -1){
+        close(readFd);
+        readFd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+/* Join Jobserver
+ * jobs     Set to the parent's -j limit, when it passed one along.
+ *
+ * MAKEFLAGS is split into words. The first word may be a run of single
+ * letter flags; -jN is read wherever it appears, and the last 
+ * jobserver option wins, as in make. jobs is only changed if the pool
+ * was joined.
+ */
+int joinJobserver(int *jobs){
+    const char *flags = getenv("MAKEFLAGS");
+    if(flags == NULL){
+        return 0;
+    }
+    char *copy = strdup(flags);
+    char *auth = NULL;
+    char *save = NULL;
+    int parentJobs = 0;
+    for(char *word = strtok_r(copy, " ", &save); word != NULL; word = strtok_r(NULL, " ", &save)){
+        if(strncmp(word, AUTH_OPTION, strlen(AUTH_OPTION)) == 0){
+            auth = word + strlen(AUTH_OPTION);
+        } else if(strncmp(word, FDS_OPTION, strlen(FDS_OPTION)) == 0){
+            auth = word + strlen(FDS_OPTION);
+        } else if(strncmp(word, "-j", 2) == 0 && atoi(word + 2) > 0){
+            parentJobs = atoi(word + 2);
+        }
+    }
+
+    int joined = 0;
+    int readEnd, writeEnd;
+    if(auth == NULL){
+        joined = 0;
+    } else if(strncmp(auth, FIFO_PREFIX, strlen(FIFO_PREFIX)) == 0){
+        joined = joinFifo(auth + strlen(FIFO_PREFIX));
+    } else if(sscanf(auth, "%d,%d", &readEnd, &writeEnd) == 2 && readEnd >= 0 && writeEnd >= 0){
+        joined = joinPipe(readEnd, writeEnd);
+    }
+    if(joined && parentJobs > 0){
+        *jobs = parentJobs;
+    }
+    free(copy);
+    return joined;
+}
+
+/* Start Jobserver
+ * jobs     The -j limit for umake and everything it starts.
+ *
+ * The pipe's descriptors are left open across exec for the children;
+ * umake itself then joins the pool like any child would. The exported 
+ * MAKEFLAGS uses the descriptor form, which every GNU make since 4.2 
+ * understands.
+ */
+int startJobserver(int jobs){
+    int fds[2];
+    if(pipe(fds) == -1){
+        perror("jobserver");
+        return 0;
+    }
+    for(int i = 0; i < jobs-1; i++){
+        char token = TOKEN;
+        if(write(fds[1], &token, 1) != 1){
+            perror("jobserver");
+            close(fds[0]);
+            close(fds[1]);
+            return 0;
+        }
+    }
+    if(!joinPipe(fds[0], fds[1])){
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    char flags[128];
+    snprintf(flags, sizeof(flags), " -j%d " AUTH_OPTION "%d,%d", jobs, fds[0], fds[1]);
+    setenv("MAKEFLAGS", flags, 1);
+    return 1;
+}
+
+/* Acquire Token
+ *
+ * A failed read (EAGAIN when the pool is empty) means no token.
+ */
+int acquireToken(){
+    if(readFd == -1){
+        return 0;
+    }
+    char token;
+    ssize_t got;
+    do {
+        got = read(readFd, &token, 1);
+    } while(got == -1 && errno == EINTR);
+    if(got != 1){
+        return 0;
+    }
+    if(heldCount == heldCap){
+        heldCap = heldCap == 0 ? 8 : heldCap*2;
+        held = realloc(held, heldCap);
+    }
+    held[heldCount++] = token;
+    return 1;
+}
+
+/* Release Token
+ *
+ * Writes the most recently taken byte back.
+ */
+void releaseToken(){
+    if(heldCount == 0){
+        return;
+    }
+    char token = held[--heldCount];
+    while(write(writeFd, &token, 1) == -1 && errno == EINTR){
+    }
+}
+
+/* Held Tokens
+ */
+int heldTokens(){
+    return heldCount;
+}
+
+/* Jobserver Descriptor
+ */
+int jobserverDescriptor(){
+    return readFd;
+}
+
+/* Close Jobserver
+ *
+ * The write end is left open: it may be a descriptor umake inherited.
+ */
+void closeJobserver(){
+    while(heldCount > 0){
+        releaseToken();
+    }
+    if(readFd != -1){
+        close(readFd);
+        readFd = -1;
+    }
+    free(held);
+    held = NULL;
+    heldCap = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef __JOBSERVER__H__
+#define __JOBSERVER__H__
+/*
+ *  CS347 jobserver.h
+ * 
+ */ 
+
+/* Join Jobserver
+ * jobs     Set to the parent's -j limit, when it passed one along.
+ *
+ * Looks in MAKEFLAGS for the jobserver of a parent make (or umake): 
+ * --jobserver-auth=R,W (or the older --jobserver-fds=R,W) naming 
+ * inherited pipe descriptors, or --jobserver-auth=fifo:PATH. Returns 1
+ * if umake joined the pool, 0 if there is none or it cannot be used.
+ */
+int joinJobserver(int *jobs);
+
+/* Start Jobserver
+ * jobs     The -j limit for umake and everything it starts.
+ *
+ * Creates a pipe holding jobs-1 tokens and exports it to child builds
+ * through MAKEFLAGS, so that a make or umake run by a rule takes its 
+ * jobs from the same pool. Returns 1 on success, 0 on failure.
+ */
+int startJobserver(int jobs);
+
+/* Acquire Token
+ *
+ * Takes a token from the pool without blocking. Every job beyond the 
+ * first umake runs needs one. Returns 1 if a token was taken, 0 if 
+ * none is free (or there is no jobserver).
+ */
+int acquireToken();
+
+/* Release Token
+ *
+ * Gives a token taken by acquireToken back to the pool.
+ */
+void releaseToken();
+
+/* Held Tokens
+ *
+ * Returns the number of tokens umake holds.
+ */
+int heldTokens();
+
+/* Jobserver Descriptor
+ *
+ * Returns a descriptor that polls readable when a token may be free,
+ * or -1 if there is no jobserver.
+ */
+int jobserverDescriptor();
+
+/* Close Jobserver
+ *
+ * Gives back every token still held and closes umake's descriptors.
+ */
+void closeJobserver();
+
+#endif
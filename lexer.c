@@ -0,0 +1,144 @@
+/*
+ *  CS347 lexer.c
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lexer.h"
+
+/* Open Lexer
+ * lexer    The lexer to set up.
+ * path     The makefile to read.
+ *
+ * The mapping is private and writable: the NUL bytes nextLine puts in
+ * place of newlines, '#', ':' and '=' only touch umake's own copy of
+ * the pages they land on, never the file. An empty file is not mapped.
+ */
+int openLexer(struct Lexer *lexer, const char *path){
+    lexer->data = NULL;
+    lexer->size = 0;
+    lexer->pos = 0;
+    lexer->last = NULL;
+
+    int fd = open(path, O_RDONLY);
+    if(fd == -1){
+        return 0;
+    }
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) == -1){
+        close(fd);
+        return 0;
+    }
+    if(fileStat.st_size > 0){
+        void *data = mmap(NULL, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED){
+            close(fd);
+            return 0;
+        }
+        lexer->data = data;
+        lexer->size = fileStat.st_size;
+    }
+    close(fd);
+    return 1;
+}
+
+/* Classify Line
+ * text     A line with its comment stripped.
+ * length   Its length.
+ * line     Filled in with the kind and slices of text.
+ *
+ * An '=' before any ':' makes a variable, so values may hold colons
+ * (PATH=${PATH}:/opt/bin). Otherwise any ':' makes a target line; its 
+ * name is the first word before the first ':'. memchr does the 
+ * scanning, so each search is a single vectorized pass.
+ */
+static void classifyLine(char *text, size_t length, struct Line *line){
+    line->text = text;
+    line->name = NULL;
+    line->value = NULL;
+    if(text[0] == '\t'){
+        line->kind = LINE_RULE;
+        return;
+    }
+
+    char *colon = memchr(text, ':', length);
+    char *equals = memchr(text, '=', colon != NULL ? (size_t)(colon - text) : length);
+    if(equals != NULL){
+        *equals = '\0';
+        line->kind = LINE_VARIABLE;
+        line->name = text;
+        line->value = equals+1;
+        return;
+    }
+    if(colon != NULL){
+        char *name = text;
+        while(name < colon && isspace((unsigned char)*name)){
+            name++;
+        }
+        char *nameEnd = name;
+        while(nameEnd < colon && !isspace((unsigned char)*nameEnd)){
+            nameEnd++;
+        }
+        *nameEnd = '\0';
+        *colon = '\0';
+        line->kind = LINE_TARGET;
+        line->name = name;
+        line->value = colon+1;
+        return;
+    }
+    line->kind = LINE_EMPTY;
+}
+
+/* Next Line
+ * lexer    An open lexer.
+ * line     Filled in with the next line.
+ *
+ * The newline ending the line (or the '#' starting its comment) is
+ * overwritten with the NUL that terminates it.
+ */
+int nextLine(struct Lexer *lexer, struct Line *line){
+    if(lexer->pos >= lexer->size){
+        return 0;
+    }
+    char *start = lexer->data + lexer->pos;
+    size_t left = lexer->size - lexer->pos;
+    char *end = memchr(start, '\n', left);
+    if(end == NULL){
+        free(lexer->last);
+        lexer->last = malloc(left+1);
+        memcpy(lexer->last, start, left);
+        start = lexer->last;
+        end = start + left;
+        lexer->pos = lexer->size;
+    } else {
+        lexer->pos = end+1 - lexer->data;
+    }
+
+    char *comment = memchr(start, '#', end - start);
+    if(comment != NULL){
+        end = comment;
+    }
+    *end = '\0';
+    classifyLine(start, end - start, line);
+    return 1;
+}
+
+/* Close Lexer
+ * lexer    An open lexer.
+ *
+ * Unmaps the makefile and frees the copy of its last line, if any.
+ */
+void closeLexer(struct Lexer *lexer){
+    if(lexer->data != NULL){
+        munmap(lexer->data, lexer->size);
+        lexer->data = NULL;
+    }
+    free(lexer->last);
+    lexer->last = NULL;
+}
@@ -0,0 +1,78 @@
+#ifndef __LEXER__H__
+#define __LEXER__H__
+/*
+ *  CS347 lexer.h
+ *
+ */
+
+#include <stddef.h>
+
+/* Line Kinds
+ *
+ * What a uMakefile line holds once its comment is stripped: a rule (a
+ * leading tab), a variable assignment (an '=' before any ':'), a target
+ * (anything else with a ':'), or nothing umake cares about.
+ */
+enum LineKind {
+    LINE_EMPTY,
+    LINE_TARGET,
+    LINE_RULE,
+    LINE_VARIABLE
+};
+
+/* Line Structure
+ *
+ * One lexed line. Every string is a slice of the mapped makefile,
+ * terminated in place, so nothing is copied. For a target, name is
+ * its first word before the ':' and value the dependency string; for
+ * a variable, name is everything before the '=' and value everything
+ * after it. A rule only has text, which keeps its leading tab.
+ */
+struct Line {
+    enum LineKind kind;
+    char *text;
+    char *name;
+    char *value;
+};
+
+/* Lexer Structure
+ *
+ * A makefile mapped copy-on-write, so that lines can be cut up in
+ * place, and the position of the next line. last holds the final
+ * line when the file does not end with a newline, since there is no
+ * byte left in the mapping to terminate it with.
+ */
+struct Lexer {
+    char *data;
+    size_t size;
+    size_t pos;
+    char *last;
+};
+
+/* Open Lexer
+ * lexer    The lexer to set up.
+ * path     The makefile to read.
+ *
+ * Maps path. Returns 1 on success, 0 if the file could not be opened.
+ */
+int openLexer(struct Lexer *lexer, const char *path);
+
+/* Next Line
+ * lexer    An open lexer.
+ * line     Filled in with the next line.
+ *
+ * Cuts the next line out of the mapping, strips its comment and works
+ * out its kind. Each byte is looked at a constant number of times, so
+ * lexing a whole makefile takes time proportional to its size. The
+ * slices stay valid until closeLexer. Returns 0 at the end of the file.
+ */
+int nextLine(struct Lexer *lexer, struct Line *line);
+
+/* Close Lexer
+ * lexer    An open lexer.
+ *
+ * Unmaps the makefile.
+ */
+void closeLexer(struct Lexer *lexer);
+
+#endif
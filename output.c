@@ -0,0 +1,384 @@
+/*
+ *  CS347 output.c
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include "output.h"
+
+/* CONSTANTS */
+
+/* How much output a stream holds in memory before it moves it to its
+ * temporary file. */
+#define OUTPUT_SPILL (1 << 20)
+
+/* The size of each read from a pipe or a file. */
+#define OUTPUT_CHUNK 65536
+
+/* The room a stream's buffer starts with. */
+#define OUTPUT_START 4096
+
+/* Write All
+ * fd       A descriptor.
+ * data     The bytes to write.
+ * length   The number of bytes.
+ *
+ * Writes every byte, going on after short writes and interruptions.
+ * Returns 0 on success, -1 if a write failed.
+ */
+static int writeAll(int fd, const char *data, size_t length){
+    while(length > 0){
+        ssize_t written = write(fd, data, length);
+        if(written == -1 && errno == EINTR){
+            continue;
+        } else if(written == -1){
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+/* Reserve
+ * stream   A stream.
+ * more     The number of bytes about to be added.
+ *
+ * Grows the stream's buffer to hold more bytes past its length.
+ */
+static void reserve(struct OutputStream *stream, size_t more){
+    if(stream->length + more <= stream->cap){
+        return;
+    }
+    size_t cap = stream->cap != 0 ? stream->cap : OUTPUT_START;
+    while(stream->length + more > cap){
+        cap *= 2;
+    }
+    stream->data = realloc(stream->data, cap);
+    stream->cap = cap;
+}
+
+/* Open Spill
+ *
+ * Returns an anonymous temporary file for held output, or -1. The file
+ * has no name, so nothing is left behind however umake exits.
+ */
+static int openSpill(){
+    const char *dir = getenv("TMPDIR");
+    if(dir == NULL || dir[0] == '\0'){
+        dir = "/tmp";
+    }
+    int fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if(fd == -1){
+        char path[] = "/tmp/umake-output-XXXXXX";
+        fd = mkostemp(path, O_CLOEXEC);
+        if(fd != -1){
+            unlink(path);
+        }
+    }
+    return fd;
+}
+
+/* Hold
+ * stream   A stream of an OUTPUT_TARGET job.
+ * data     Bytes read from its pipe.
+ * length   The number of bytes.
+ *
+ * Adds the bytes to the buffer. A buffer that would grow past
+ * OUTPUT_SPILL is appended to the stream's temporary file instead and
+ * emptied, so a job that prints a lot costs no more than OUTPUT_SPILL
+ * bytes of memory. If no file can be made the buffer simply grows.
+ */
+static void hold(struct OutputStream *stream, const char *data, size_t length){
+    if(stream->length + length > OUTPUT_SPILL){
+        if(stream->spill == -1){
+            stream->spill = openSpill();
+        }
+        if(stream->spill != -1 && writeAll(stream->spill, stream->data, stream->length) == 0
+                && writeAll(stream->spill, data, length) == 0){
+            stream->length = 0;
+            return;
+        }
+    }
+    reserve(stream, length);
+    memcpy(stream->data + stream->length, data, length);
+    stream->length += length;
+}
+
+/* Emit Lines
+ * stream   A stream of an OUTPUT_LINE job.
+ * name     The job's target.
+ * data     Bytes read from its pipe.
+ * length   The number of bytes.
+ * last     Whether no more bytes will come.
+ *
+ * Writes each complete line, the partial line held from before first,
+ * as "[name] line", all of them in one write so that lines from
+ * different jobs never mix. What follows the last newline is held for
+ * the next read; once last is set it is written as a line of its own.
+ */
+static void emitLines(struct OutputStream *stream, const char *name, const char *data,
+        size_t length, int last){
+    reserve(stream, length);
+    memcpy(stream->data + stream->length, data, length);
+    stream->length += length;
+    if(!last && memchr(data, '\n', length) == NULL){
+        return;
+    }
+
+    size_t prefix = strlen(name) + 3;
+    size_t size = 0;
+    size_t lines = 0;
+    size_t start = 0;
+    for(size_t i = 0; i < stream->length; i++){
+        if(stream->data[i] == '\n'){
+            size += prefix + i+1 - start;
+            lines++;
+            start = i+1;
+        }
+    }
+    int tail = last && start < stream->length;
+    if(tail){
+        size += prefix + stream->length - start + 1;
+    }
+    if(size == 0){
+        return;
+    }
+
+    char *text = malloc(size);
+    char *cursor = text;
+    start = 0;
+    for(size_t i = 0; i < stream->length; i++){
+        if(stream->data[i] == '\n' || (tail && i+1 == stream->length)){
+            cursor += sprintf(cursor, "[%s] ", name);
+            memcpy(cursor, stream->data + start, i+1 - start);
+            cursor += i+1 - start;
+            start = i+1;
+        }
+    }
+    if(tail){
+        *cursor++ = '\n';
+    }
+    writeAll(stream->dest, text, cursor - text);
+    free(text);
+
+    memmove(stream->data, stream->data + start, stream->length - start);
+    stream->length -= start;
+}
+
+/* Take
+ * output   The job's output.
+ * stream   One of its streams.
+ * data     Bytes read for the stream.
+ * length   The number of bytes.
+ *
+ * Passes the bytes to hold or emitLines, by the job's mode.
+ */
+static void take(struct JobOutput *output, struct OutputStream *stream, const char *data,
+        size_t length){
+    if(output->mode == OUTPUT_LINE){
+        emitLines(stream, output->name, data, length, 0);
+    } else {
+        hold(stream, data, length);
+    }
+}
+
+/* Flush Stream
+ * output   The job's output.
+ * stream   One of its streams, its pipe drained.
+ *
+ * Writes what the stream holds to its destination: the temporary file
+ * first, then the buffer.
+ */
+static void flushStream(struct JobOutput *output, struct OutputStream *stream){
+    if(output->mode == OUTPUT_LINE){
+        emitLines(stream, output->name, NULL, 0, 1);
+        return;
+    }
+    if(stream->spill != -1 && lseek(stream->spill, 0, SEEK_SET) == 0){
+        char chunk[OUTPUT_CHUNK];
+        ssize_t got;
+        while((got = read(stream->spill, chunk, sizeof(chunk))) > 0){
+            writeAll(stream->dest, chunk, got);
+        }
+    }
+    writeAll(stream->dest, stream->data, stream->length);
+    stream->length = 0;
+}
+
+/* Close Stream
+ * stream   One of a job's streams.
+ * events   The epoll instance its pipe was added to.
+ */
+static void closeStream(struct OutputStream *stream, int events){
+    if(stream->readFd != -1){
+        epoll_ctl(events, EPOLL_CTL_DEL, stream->readFd, NULL);
+        close(stream->readFd);
+    }
+    if(stream->writeFd != -1){
+        close(stream->writeFd);
+    }
+    if(stream->spill != -1){
+        close(stream->spill);
+    }
+    free(stream->data);
+    stream->readFd = stream->writeFd = stream->spill = -1;
+    stream->data = NULL;
+    stream->length = stream->cap = 0;
+}
+
+/* Parse Output Mode
+ * text     none, target or line.
+ */
+int parseOutputMode(const char *text){
+    if(strcmp(text, "none") == 0){
+        return OUTPUT_NONE;
+    } else if(strcmp(text, "target") == 0){
+        return OUTPUT_TARGET;
+    } else if(strcmp(text, "line") == 0){
+        return OUTPUT_LINE;
+    }
+    return -1;
+}
+
+/* Open Job Output
+ * output   The job's output to set up.
+ * name     The target's name.
+ * mode     OUTPUT_TARGET or OUTPUT_LINE.
+ * events   An epoll instance.
+ *
+ * The read ends are non-blocking, so that draining one stops when it
+ * is empty, and every descriptor is close-on-exec: children get the
+ * write ends only as their 1 and 2, never another job's pipes. The
+ * builtin files are made when a builtin first needs them.
+ */
+int openJobOutput(struct JobOutput *output, const char *name, enum OutputMode mode, int events){
+    output->name = name;
+    output->mode = mode;
+    output->builtinFds[0] = output->builtinFds[1] = -1;
+    for(int i = 0; i < 2; i++){
+        struct OutputStream *stream = &output->streams[i];
+        stream->readFd = stream->writeFd = stream->spill = -1;
+        stream->dest = i == 0 ? STDOUT_FILENO : STDERR_FILENO;
+        stream->data = NULL;
+        stream->length = stream->cap = 0;
+    }
+    for(int i = 0; i < 2; i++){
+        struct OutputStream *stream = &output->streams[i];
+        int ends[2];
+        if(pipe2(ends, O_CLOEXEC) == -1){
+            closeJobOutput(output, events);
+            return 0;
+        }
+        stream->readFd = ends[0];
+        stream->writeFd = ends[1];
+        fcntl(stream->readFd, F_SETFL, O_NONBLOCK);
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = stream->readFd;
+        if(epoll_ctl(events, EPOLL_CTL_ADD, stream->readFd, &event) == -1){
+            closeJobOutput(output, events);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Owns Descriptor
+ * output   An open job output.
+ * fd       A descriptor epoll reported.
+ */
+int ownsDescriptor(struct JobOutput *output, int fd){
+    return fd != -1 && (output->streams[0].readFd == fd || output->streams[1].readFd == fd);
+}
+
+/* Drain Output
+ * output   An open job output.
+ * fd       The read end of one of its pipes.
+ */
+void drainOutput(struct JobOutput *output, int fd){
+    struct OutputStream *stream = &output->streams[output->streams[0].readFd == fd ? 0 : 1];
+    char chunk[OUTPUT_CHUNK];
+    ssize_t got;
+    while((got = read(fd, chunk, sizeof(chunk))) > 0 || (got == -1 && errno == EINTR)){
+        if(got > 0){
+            take(output, stream, chunk, got);
+        }
+    }
+}
+
+/* Builtin Output
+ * output   An open job output.
+ * stream   0 for standard output, 1 for standard error.
+ *
+ * A builtin runs inside umake, so it cannot write into the job's pipes:
+ * once a pipe filled up nothing would be left to empty it. It writes
+ * to a memory file instead, which collectBuiltin empties. If no memory
+ * file can be made the builtin writes to umake's own descriptor.
+ */
+int builtinOutput(struct JobOutput *output, int stream){
+    if(output->builtinFds[stream] == -1){
+        output->builtinFds[stream] = memfd_create("umake-builtin", MFD_CLOEXEC);
+        if(output->builtinFds[stream] == -1){
+            return output->streams[stream].dest;
+        }
+    }
+    return output->builtinFds[stream];
+}
+
+/* Collect Builtin
+ * output   An open job output.
+ *
+ * Whatever a pipe already holds was written before the builtin ran,
+ * so it is taken first to keep the order.
+ */
+void collectBuiltin(struct JobOutput *output){
+    for(int i = 0; i < 2; i++){
+        int fd = output->builtinFds[i];
+        if(fd == -1 || lseek(fd, 0, SEEK_SET) != 0){
+            continue;
+        }
+        drainOutput(output, output->streams[i].readFd);
+        char chunk[OUTPUT_CHUNK];
+        ssize_t got;
+        while((got = read(fd, chunk, sizeof(chunk))) > 0){
+            take(output, &output->streams[i], chunk, got);
+        }
+        ftruncate(fd, 0);
+        lseek(fd, 0, SEEK_SET);
+    }
+}
+
+/* Close Job Output
+ * output   An open job output whose rules have all finished.
+ * events   The epoll instance its pipes were added to.
+ *
+ * Every child of the job has exited by now, so what they wrote is in
+ * the pipes already. A child that left something running in the
+ * background with the pipe open would keep it from ending, which is
+ * why the pipes are only drained and never read to their end.
+ */
+void closeJobOutput(struct JobOutput *output, int events){
+    for(int i = 0; i < 2; i++){
+        struct OutputStream *stream = &output->streams[i];
+        if(stream->readFd != -1){
+            drainOutput(output, stream->readFd);
+        }
+        flushStream(output, stream);
+        closeStream(stream, events);
+    }
+    for(int i = 0; i < 2; i++){
+        if(output->builtinFds[i] != -1){
+            close(output->builtinFds[i]);
+            output->builtinFds[i] = -1;
+        }
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef __OUTPUT__H__
+#define __OUTPUT__H__
+/*
+ *  CS347 output.h
+ *
+ */
+
+#include <stddef.h>
+
+/* Output Modes
+ *
+ * What --output-sync does with the output of a parallel build's jobs:
+ * OUTPUT_NONE lets every child write straight to umake's stdout and
+ * stderr, OUTPUT_TARGET holds a target's output until its last rule
+ * line finishes and writes it in one piece, and OUTPUT_LINE passes
+ * each complete line on at once, prefixed with the target's name.
+ */
+enum OutputMode {
+    OUTPUT_NONE,
+    OUTPUT_TARGET,
+    OUTPUT_LINE
+};
+
+/* Output Stream Structure
+ *
+ * One of a job's two streams: the pipe its children write to, what has
+ * been read from it and not written out yet, and the temporary file
+ * the held output spills into once it grows past OUTPUT_SPILL bytes.
+ * dest is umake's descriptor the stream ends up on.
+ */
+struct OutputStream {
+    int readFd;
+    int writeFd;
+    int dest;
+
+    char *data;
+    size_t length;
+    size_t cap;
+    int spill;
+};
+
+/* Job Output Structure
+ *
+ * The captured output of one target's rules: its stdout and stderr
+ * streams, and the memory files in-process builtins write their
+ * stdout and stderr to.
+ */
+struct JobOutput {
+    const char *name;
+    enum OutputMode mode;
+    struct OutputStream streams[2];
+    int builtinFds[2];
+};
+
+/* Parse Output Mode
+ * text     none, target or line.
+ *
+ * Returns the mode, or -1 if text names none of them.
+ */
+int parseOutputMode(const char *text);
+
+/* Open Job Output
+ * output   The job's output to set up.
+ * name     The target's name, used as the prefix in OUTPUT_LINE mode.
+ * mode     OUTPUT_TARGET or OUTPUT_LINE.
+ * events   An epoll instance the pipes' read ends are added to.
+ *
+ * Creates the two pipes. Returns 1 on success, 0 on failure.
+ */
+int openJobOutput(struct JobOutput *output, const char *name, enum OutputMode mode, int events);
+
+/* Owns Descriptor
+ * output   An open job output.
+ * fd       A descriptor epoll reported.
+ *
+ * Returns 1 if fd is the read end of one of output's pipes.
+ */
+int ownsDescriptor(struct JobOutput *output, int fd);
+
+/* Drain Output
+ * output   An open job output.
+ * fd       The read end of one of its pipes.
+ *
+ * Reads whatever the pipe holds without blocking, holding it (or, in
+ * OUTPUT_LINE mode, writing out the complete lines).
+ */
+void drainOutput(struct JobOutput *output, int fd);
+
+/* Builtin Output
+ * output   An open job output.
+ * stream   0 for standard output, 1 for standard error.
+ *
+ * Returns the descriptor a builtin run for the job writes that stream
+ * to.
+ */
+int builtinOutput(struct JobOutput *output, int stream);
+
+/* Collect Builtin
+ * output   An open job output.
+ *
+ * Moves what a builtin just wrote into the job's stdout and stderr
+ * streams.
+ */
+void collectBuiltin(struct JobOutput *output);
+
+/* Close Job Output
+ * output   An open job output whose rules have all finished.
+ * events   The epoll instance its pipes were added to.
+ *
+ * Drains both pipes, writes out everything still held, stdout first,
+ * and closes the pipes and files.
+ */
+void closeJobOutput(struct JobOutput *output, int events);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ *  CS347 resources.c
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "target.h"
+#include "resources.h"
+
+/* CONSTANTS */
+
+#define LOADAVG_FILE "/proc/loadavg"
+#define MEMINFO_FILE "/proc/meminfo"
+
+/* Parse Size
+ * text     A size.
+ *
+ * A plain number counts bytes; a suffix (in either case) multiplies it
+ * by a power of 1024. An optional B may follow the suffix.
+ */
+long long parseSize(const char *text){
+    char *end;
+    double value = strtod(text, &end);
+    if(end == text || value < 0){
+        return -1;
+    }
+    double bytes = value;
+    switch(toupper((unsigned char)*end)){
+        case 'T':
+            bytes *= 1024;
+            /* fall through */
+        case 'G':
+            bytes *= 1024;
+            /* fall through */
+        case 'M':
+            bytes *= 1024;
+            /* fall through */
+        case 'K':
+            bytes *= 1024;
+            end++;
+            if(toupper((unsigned char)*end) == 'B'){
+                end++;
+            }
+            break;
+        case 'B':
+            end++;
+            break;
+    }
+    if(*end != '\0'){
+        return -1;
+    }
+    return (long long)((bytes + 1023) / 1024);
+}
+
+/* Parse Resources
+ * target   The target whose line declared the resources.
+ * spec     The words after .RESOURCES on the line.
+ *
+ * Works on a copy of spec, cut into words in place.
+ */
+void parseResources(struct Target *target, const char *spec){
+    char *copy = malloc(strlen(spec)+1);
+    strcpy(copy, spec);
+    char *save;
+    for(char *word = strtok_r(copy, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save)){
+        if(strncmp(word, "jobs=", 5) == 0 && atoi(word+5) >= 1){
+            target->jobWeight = atoi(word+5);
+        } else if(strncmp(word, "mem=", 4) == 0 && parseSize(word+4) >= 0){
+            target->memWeight = parseSize(word+4);
+        } else {
+            fprintf(stderr, "ERROR: Unknown resource %s for target %s.\n", word, target->targetName);
+        }
+    }
+    free(copy);
+}
+
+/* System Load
+ *
+ * The 1-minute load average lags a minute behind the jobs umake has
+ * just started, so the number of threads runnable right now (less
+ * umake itself) counts too, whichever is higher.
+ */
+double systemLoad(){
+    FILE *file = fopen(LOADAVG_FILE, "r");
+    if(file == NULL){
+        return -1;
+    }
+    double average;
+    int runnable;
+    int read = fscanf(file, "%lf %*f %*f %d/", &average, &runnable);
+    fclose(file);
+    if(read < 1){
+        return -1;
+    }
+    if(read == 2 && runnable - 1 > average){
+        return runnable - 1;
+    }
+    return average;
+}
+
+/* Available Memory
+ *
+ * Scans /proc/meminfo for its MemAvailable line.
+ */
+long long availableMemory(){
+    FILE *file = fopen(MEMINFO_FILE, "r");
+    if(file == NULL){
+        return -1;
+    }
+    char line[256];
+    long long available = -1;
+    while(fgets(line, sizeof(line), file) != NULL){
+        if(sscanf(line, "MemAvailable: %lld kB", &available) == 1){
+            break;
+        }
+    }
+    fclose(file);
+    return available;
+}
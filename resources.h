@@ -0,0 +1,45 @@
+#ifndef __RESOURCES__H__
+#define __RESOURCES__H__
+/*
+ *  CS347 resources.h
+ *
+ */
+
+#include "target.h"
+
+/* Parse Size
+ * text     A size in bytes, or in K, M, G or T (powers of 1024), such
+ *          as 512M or 4G.
+ *
+ * Returns the size in kilobytes, rounded up, or -1 if text is not a
+ * size.
+ */
+long long parseSize(const char *text);
+
+/* Parse Resources
+ * target   The target whose line declared the resources.
+ * spec     The words after .RESOURCES on the line.
+ *
+ * Sets the target's weights from words of the form jobs=N (the number
+ * of job slots its rules take, for a target that runs a parallel tool
+ * such as a linker with threads) and mem=SIZE (the memory they need).
+ * A word that is neither is reported and skipped.
+ */
+void parseResources(struct Target *target, const char *spec);
+
+/* System Load
+ *
+ * Returns the load --max-load compares against, read from
+ * /proc/loadavg, or -1 if it cannot be read.
+ */
+double systemLoad();
+
+/* Available Memory
+ *
+ * Returns MemAvailable from /proc/meminfo in kilobytes: the memory
+ * that can be handed to new processes without swapping. Returns -1 if
+ * it cannot be read.
+ */
+long long availableMemory();
+
+#endif
@@ -0,0 +1,339 @@
+/*
+ *  CS347 statbatch.c
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <linux/io_uring.h>
+#include "statcache.h"
+#include "statbatch.h"
+
+/* CONSTANTS */
+
+/* The number of submission queue entries asked for. */
+#define RING_ENTRIES 256
+
+/* The most threads the fallback uses, and how many files each thread
+ * should at least get. */
+#define POOL_THREADS 8
+#define POOL_SHARE 32
+
+/* Ring Structure
+ *
+ * An io_uring set up with the raw system calls: the shared submission
+ * and completion rings, mapped from the kernel, and the array of
+ * submission entries.
+ */
+struct Ring {
+    int fd;
+    unsigned entries;
+
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    struct io_uring_sqe *sqes;
+
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+
+    void *sqMap;
+    size_t sqSize;
+    void *cqMap;
+    size_t cqSize;
+    size_t sqesSize;
+};
+
+/* Pool Structure
+ *
+ * The work shared by the fallback threads: each takes the next entry
+ * by bumping next until every entry is taken.
+ */
+struct Pool {
+    struct FileInfo **infos;
+    int count;
+    int next;
+};
+
+/* Set once io_uring_enter has failed: the ring is not used again for 
+ * the rest of the run. */
+static int ringFailed = 0;
+
+/* Fill From Statx
+ * info     The entry to fill in.
+ * result   The statx result for its path, or NULL if the call failed.
+ *
+ * Records the same values fillInfo in statcache.c takes from stat().
+ */
+static void fillFromStatx(struct FileInfo *info, const struct statx *result){
+    if(result != NULL){
+        info->exists = 1;
+        info->mtime = (long long)result->stx_mtime.tv_sec * 1000000000LL + result->stx_mtime.tv_nsec;
+        info->size = result->stx_size;
+        info->inode = result->stx_ino;
+        info->device = makedev(result->stx_dev_major, result->stx_dev_minor);
+    } else {
+        info->exists = 0;
+        info->mtime = 0;
+        info->size = 0;
+        info->inode = 0;
+        info->device = 0;
+    }
+}
+
+/* Stat One
+ * info     The entry to fill in.
+ *
+ * Fills in one entry with a blocking statx().
+ */
+static void statOne(struct FileInfo *info){
+    struct statx result;
+    if(statx(AT_FDCWD, info->path, 0, STATX_BASIC_STATS, &result) == 0){
+        fillFromStatx(info, &result);
+    } else {
+        fillFromStatx(info, NULL);
+    }
+}
+
+/* Open Ring
+ * ring     The ring to set up.
+ *
+ * Calls io_uring_setup and maps the rings (once, when the kernel
+ * offers IORING_FEAT_SINGLE_MMAP). Returns 1 on success, 0 if io_uring
+ * cannot be used.
+ */
+static int openRing(struct Ring *ring){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+    if(ring->fd < 0){
+        return 0;
+    }
+    ring->entries = params.sq_entries;
+    ring->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single && ring->cqSize > ring->sqSize){
+        ring->sqSize = ring->cqSize;
+    }
+
+    ring->sqMap = mmap(NULL, ring->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sqMap == MAP_FAILED){
+        close(ring->fd);
+        return 0;
+    }
+    if(single){
+        ring->cqMap = ring->sqMap;
+    } else {
+        ring->cqMap = mmap(NULL, ring->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cqMap == MAP_FAILED){
+            munmap(ring->sqMap, ring->sqSize);
+            close(ring->fd);
+            return 0;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED){
+        if(!single){
+            munmap(ring->cqMap, ring->cqSize);
+        }
+        munmap(ring->sqMap, ring->sqSize);
+        close(ring->fd);
+        return 0;
+    }
+
+    char *sq = ring->sqMap;
+    char *cq = ring->cqMap;
+    ring->sqHead = (unsigned *)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 1;
+}
+
+/* Close Ring
+ * ring     A ring set up by openRing.
+ */
+static void closeRing(struct Ring *ring){
+    munmap(ring->sqes, ring->sqesSize);
+    if(ring->cqMap != ring->sqMap){
+        munmap(ring->cqMap, ring->cqSize);
+    }
+    munmap(ring->sqMap, ring->sqSize);
+    close(ring->fd);
+}
+
+/* Drain Ring
+ * ring     An open ring.
+ * pending  The number of operations submitted and not yet completed.
+ *
+ * Waits for every pending operation to complete, dropping their 
+ * completions. Returns 0, or -1 if waiting failed.
+ */
+static int drainRing(struct Ring *ring, int pending){
+    while(pending > 0){
+        unsigned head = *ring->cqHead;
+        unsigned completed = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        pending -= completed - head;
+        __atomic_store_n(ring->cqHead, completed, __ATOMIC_RELEASE);
+        if(pending > 0 && syscall(__NR_io_uring_enter, ring->fd, 0, 1, 
+                IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Ring Batch
+ * ring     An open ring.
+ * infos    The entries to fill in.
+ * count    The number of entries.
+ *
+ * Keeps up to a ring's worth of IORING_OP_STATX operations in flight,
+ * each writing into its own slot of a results array, and fills an
+ * entry in as its completion arrives. A completion with an error other
+ * than a missing file (such as -EINVAL from a kernel without statx
+ * support in io_uring) is retried with a blocking statx. Returns 
+ * count, or -1 if io_uring_enter failed. Operations submitted before
+ * the failure write into the results array from the kernel's own 
+ * threads, which closing the ring does not wait for, so they are
+ * drained before it is freed; if even that fails it is left allocated.
+ */
+static int ringBatch(struct Ring *ring, struct FileInfo **infos, int count){
+    struct statx *results = malloc(count * sizeof(struct statx));
+    int next = 0;
+    int done = 0;
+    int inFlight = 0;
+    unsigned unsubmitted = 0;
+
+    while(done < count){
+        unsigned tail = *ring->sqTail;
+        while(next < count && inFlight < (int)ring->entries){
+            unsigned index = tail & *ring->sqMask;
+            struct io_uring_sqe *sqe = &ring->sqes[index];
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)infos[next]->path;
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (unsigned long)&results[next];
+            sqe->user_data = next;
+            ring->sqArray[index] = index;
+            tail++;
+            next++;
+            inFlight++;
+            unsubmitted++;
+        }
+        __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+        int submitted = syscall(__NR_io_uring_enter, ring->fd, unsubmitted, 1,
+                IORING_ENTER_GETEVENTS, NULL, 0);
+        if(submitted < 0 && errno == EINTR){
+            continue;
+        } else if(submitted < 0){
+            if(drainRing(ring, inFlight - unsubmitted) == 0){
+                free(results);
+            }
+            return -1;
+        }
+        unsubmitted -= submitted;
+
+        unsigned head = *ring->cqHead;
+        unsigned completed = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        while(head != completed){
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cqMask];
+            struct FileInfo *info = infos[cqe->user_data];
+            if(cqe->res == 0){
+                fillFromStatx(info, &results[cqe->user_data]);
+            } else if(cqe->res == -ENOENT || cqe->res == -ENOTDIR){
+                fillFromStatx(info, NULL);
+            } else {
+                statOne(info);
+            }
+            head++;
+            done++;
+            inFlight--;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+    free(results);
+    return count;
+}
+
+/* Stat Worker
+ * arg      The shared pool.
+ *
+ * Takes entries from the pool until none are left.
+ */
+static void *statWorker(void *arg){
+    struct Pool *pool = arg;
+    int i;
+    while((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->count){
+        statOne(pool->infos[i]);
+    }
+    return NULL;
+}
+
+/* Pool Batch
+ * infos    The entries to fill in.
+ * count    The number of entries.
+ *
+ * Starts one thread per POOL_SHARE entries, up to POOL_THREADS, and
+ * works alongside them on the calling thread.
+ */
+static void poolBatch(struct FileInfo **infos, int count){
+    struct Pool pool = {infos, count, 0};
+    pthread_t threads[POOL_THREADS];
+    int started = 0;
+    while(started < POOL_THREADS-1 && (started+1)*POOL_SHARE < count){
+        if(pthread_create(&threads[started], NULL, statWorker, &pool) != 0){
+            break;
+        }
+        started++;
+    }
+    statWorker(&pool);
+    for(int i = 0; i < started; i++){
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/* Stat Batch
+ * infos    Entries whose path is set, the rest still to be filled in.
+ * count    The number of entries.
+ *
+ * If the ring fails part way, every entry is filled in again by the
+ * thread pool, which is harmless for the ones already done, and later
+ * batches go straight to the pool.
+ */
+void statBatch(struct FileInfo **infos, int count){
+    struct Ring ring;
+    if(!ringFailed && openRing(&ring)){
+        int done = ringBatch(&ring, infos, count);
+        closeRing(&ring);
+        if(done == count){
+            return;
+        }
+        ringFailed = 1;
+    }
+    poolBatch(infos, count);
+}
@@ -0,0 +1,22 @@
+#ifndef __STATBATCH__H__
+#define __STATBATCH__H__
+/*
+ *  CS347 statbatch.h
+ *
+ */
+
+#include "statcache.h"
+
+/* Stat Batch
+ * infos    Entries whose path is set, the rest still to be filled in.
+ * count    The number of entries.
+ *
+ * Fills in every entry just as statFile would, but with the calls in
+ * flight together rather than one after another: as statx operations
+ * submitted in batches to an io_uring, or, where io_uring is not
+ * available, spread over a pool of threads. On a cold page cache or a
+ * network file system this overlaps the latency of each call.
+ */
+void statBatch(struct FileInfo **infos, int count);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ *  CS347 statcache.c
+ *  
+ */ 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> 
+#include <sys/stat.h>
+#include <time.h>
+#include "target.h"
+#include "statcache.h"
+#include "statbatch.h"
+
+/* CONSTANTS */
+
+/* The number of buckets the cache starts with; it doubles whenever 
+ * it holds more entries than buckets. */
+#define STAT_BUCKETS 4096
+
+/* Fewer new paths than this are stat()ed one by one by prefetchFiles;
+ * setting up a ring or threads would cost more than it saves. */
+#define PREFETCH_MIN 64
+
+/* The cache: bucketCount buckets (a power of two), each a chain of 
+ * FileInfo entries, holding entryCount entries in all. */
+static struct FileInfo **buckets = NULL;
+static unsigned long bucketCount = 0;
+static unsigned long entryCount = 0;
+
+/* Grow Buckets
+ *
+ * Allocates the first STAT_BUCKETS buckets, or doubles the table and
+ * moves every entry to its new bucket using its stored hash.
+ */
+static void growBuckets(){
+    unsigned long newCount = bucketCount == 0 ? STAT_BUCKETS : 2 * bucketCount;
+    struct FileInfo **newBuckets = calloc(newCount, sizeof(struct FileInfo *));
+    for(unsigned long i = 0; i < bucketCount; i++){
+        struct FileInfo *current = buckets[i];
+        while(current != NULL){
+            struct FileInfo *next = current->next;
+            current->next = newBuckets[current->hash & (newCount - 1)];
+            newBuckets[current->hash & (newCount - 1)] = current;
+            current = next;
+        }
+    }
+    free(buckets);
+    buckets = newBuckets;
+    bucketCount = newCount;
+}
+
+/* Fill Info
+ * info     The entry to fill in from its path.
+ *
+ * Calls stat() once and records the result, with the modification 
+ * time as nanoseconds since the epoch so that files written within 
+ * the same second still compare correctly.
+ */
+static void fillInfo(struct FileInfo *info){
+    struct stat fileStat;
+    if(stat(info->path, &fileStat) == 0){
+        info->exists = 1;
+        info->mtime = (long long)fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec;
+        info->size = fileStat.st_size;
+        info->inode = fileStat.st_ino;
+        info->device = fileStat.st_dev;
+    } else {
+        info->exists = 0;
+        info->mtime = 0;
+        info->size = 0;
+        info->inode = 0;
+        info->device = 0;
+    }
+}
+
+/* Find Info
+ * path     The file to look up.
+ * created  Set to 1 if the entry is new, 0 if it was already cached.
+ *
+ * Finds path in its bucket, or adds a new entry for it whose metadata
+ * is still to be filled in.
+ */
+static struct FileInfo *findInfo(const char *path, int *created){
+    if(entryCount >= bucketCount){
+        growBuckets();
+    }
+    unsigned long hash = hashName(path);
+    struct FileInfo *current = buckets[hash & (bucketCount - 1)];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->path, path) == 0){
+            *created = 0;
+            return current;
+        }
+        current = current->next;
+    }
+    current = malloc(sizeof(struct FileInfo));
+    current->path = malloc(strlen(path)+1);
+    strcpy(current->path, path);
+    current->hash = hash;
+    current->next = buckets[hash & (bucketCount - 1)];
+    buckets[hash & (bucketCount - 1)] = current;
+    entryCount++;
+    *created = 1;
+    return current;
+}
+
+/* Stat File
+ * path     The file to look up.
+ *
+ * Finds path in its bucket, or creates and fills a new entry for it.
+ */
+struct FileInfo *statFile(const char *path){
+    int created;
+    struct FileInfo *info = findInfo(path, &created);
+    if(created){
+        fillInfo(info);
+    }
+    return info;
+}
+
+/* Prefetch Files
+ * paths    The files to look up.
+ * count    The number of paths.
+ *
+ * Adds an entry for every path not yet cached (a path listed twice
+ * gets one entry), then fills the new entries in together with
+ * statBatch.
+ */
+void prefetchFiles(const char **paths, int count){
+    struct FileInfo **fresh = malloc(count * sizeof(struct FileInfo *));
+    int freshCount = 0;
+    for(int i = 0; i < count; i++){
+        int created;
+        struct FileInfo *info = findInfo(paths[i], &created);
+        if(created){
+            fresh[freshCount++] = info;
+        }
+    }
+    if(freshCount >= PREFETCH_MIN){
+        statBatch(fresh, freshCount);
+    } else {
+        for(int i = 0; i < freshCount; i++){
+            fillInfo(fresh[i]);
+        }
+    }
+    free(fresh);
+}
+
+/* Cached File
+ * path     A file.
+ */
+struct FileInfo *cachedFile(const char *path){
+    if(bucketCount == 0){
+        return NULL;
+    }
+    unsigned long hash = hashName(path);
+    struct FileInfo *current = buckets[hash & (bucketCount - 1)];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->path, path) == 0){
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+/* Invalidate File
+ * path     A file that may have been changed.
+ *
+ * Re-reads the metadata of a cached entry in place, so pointers to
+ * it held by callers stay valid. Paths not in the cache are not added,
+ * and no other entry is touched.
+ */
+void invalidateFile(const char *path){
+    struct FileInfo *info = cachedFile(path);
+    if(info != NULL){
+        fillInfo(info);
+    }
+}
+
+/* File Clock
+ *
+ * Reads CLOCK_REALTIME_COARSE, the clock the kernel stamps files with.
+ */
+long long fileClock(){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Clear Stat Cache
+ *
+ * Frees every entry in every bucket, and the buckets themselves; the
+ * next lookup starts a new table.
+ */
+void clearStatCache(){
+    for(unsigned long i = 0; i < bucketCount; i++){
+        struct FileInfo *current = buckets[i];
+        while(current != NULL){
+            struct FileInfo *next = current->next;
+            free(current->path);
+            free(current);
+            current = next;
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+    bucketCount = 0;
+    entryCount = 0;
+}
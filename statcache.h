@@ -0,0 +1,79 @@
+#ifndef __STATCACHE__H__
+#define __STATCACHE__H__
+/*
+ *  CS347 statcache.h
+ * 
+ */ 
+
+#include <sys/types.h>
+
+/* File Info Structure
+ *
+ * What umake remembers about one path for the length of a run: 
+ * whether it exists, its modification time in nanoseconds, its size
+ * and inode. Entries are chained in the buckets of the stat cache.
+ */
+struct FileInfo {
+    char *path;
+    unsigned long hash;
+
+    int exists;
+    long long mtime;
+    off_t size;
+    ino_t inode;
+    dev_t device;
+
+    struct FileInfo *next;
+};
+
+/* Stat File
+ * path     The file to look up.
+ *
+ * Returns the cached metadata of path, calling stat() only the first
+ * time a path is asked for (or after it has been invalidated). The 
+ * returned entry stays valid until clearStatCache is called.
+ */
+struct FileInfo *statFile(const char *path);
+
+/* Prefetch Files
+ * paths    The files a build is about to look up.
+ * count    The number of paths.
+ *
+ * Fills the cache for every path not already in it, batching the
+ * system calls rather than making them one at a time as statFile
+ * would. Later statFile calls on these paths are cache hits.
+ */
+void prefetchFiles(const char **paths, int count);
+
+/* Cached File
+ * path     A file.
+ *
+ * Returns the cached metadata of path as it was last read, without 
+ * reading it again, or NULL if path is not in the cache.
+ */
+struct FileInfo *cachedFile(const char *path);
+
+/* Invalidate File
+ * path     A file that may have been changed.
+ *
+ * Refreshes the cached metadata of path, so later statFile calls
+ * see the file as it is now. Called for each file a target's rules
+ * may have written, once they have run.
+ */
+void invalidateFile(const char *path);
+
+/* File Clock
+ *
+ * Returns the time, in nanoseconds, from the clock the kernel stamps
+ * files with. It is coarser than CLOCK_REALTIME, and a file written
+ * after this call can never have an older modification time.
+ */
+long long fileClock();
+
+/* Clear Stat Cache
+ *
+ * Frees every entry in the cache.
+ */
+void clearStatCache();
+
+#endif
@@ -8,20 +8,205 @@
 #include <stdlib.h>
 #include <string.h> 
 #include <ctype.h>
+#include "arg_parse.h"
+#include "arena.h"
+#include "command.h"
+#include "resources.h"
 #include "target.h"
 
-/* Create Target 
- * A constructor for the target structure.  
+/* CONSTANTS */
+
+/* The word on a target line after which its resource weights follow. */
+#define RESOURCES_WORD ".RESOURCES"
+
+/* Target Index
+ *
+ * An open addressing hash table (with linear probing) from target 
+ * names to targets, hung off the head of a target list. cap is always 
+ * a power of two and the table doubles before it gets 3/4 full. tail 
+ * is the last target of the list, so that appending does not have to
+ * walk it.
+ *
+ * The index also owns the memory of the graph: every target, rule, 
+ * command, string and edge array added to the list is allocated from 
+ * arena, so freeAll releases them in one go. Target and dependency 
+ * names are interned in names (a second probing table, sized like 
+ * slots), so each distinct name is stored once.
  */
-targ createTarget(){
-    targ temp; 
-    temp = malloc(sizeof(struct Target));
-    temp->ruleList = createRule();
+struct TargetIndex {
+    struct Target **slots;
+    unsigned long cap;
+    unsigned long count;
+    struct Target *tail;
+    int size;
+
+    struct Arena arena;
+    char **names;
+    unsigned long nameCap;
+    unsigned long nameCount;
+};
+
+/* Hash Name
+ * name     The string to hash.
+ *
+ * 64-bit FNV-1a hash of name.
+ */
+unsigned long hashName(const char *name){
+    unsigned long hash = 14695981039346656037UL;
+    for(const unsigned char *c = (const unsigned char *)name; *c != '\0'; c++){
+        hash ^= *c;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/* Get Index
+ * head     The head of a target list.
+ *
+ * Returns the index of the list, creating an empty one the first
+ * time the list is added to.
+ */
+static struct TargetIndex *getIndex(struct Target *head){
+    if(head->index == NULL){
+        head->index = calloc(1, sizeof(struct TargetIndex));
+        head->index->cap = 64;
+        head->index->slots = calloc(head->index->cap, sizeof(struct Target *));
+        head->index->nameCap = 64;
+        head->index->names = calloc(head->index->nameCap, sizeof(char *));
+        head->index->tail = head;
+        while(head->index->tail->next != NULL){
+            head->index->tail = head->index->tail->next;
+        }
+    }
+    return head->index;
+}
+
+/* Index Insert
+ * index    The index to add to.
+ * target   A target with its name and nameHash set.
+ *
+ * Adds target to the index unless a target with the same name is
+ * already there (the first definition of a name wins, as it does for
+ * a linear search of the list). Doubles the table when needed.
+ */
+static void indexInsert(struct TargetIndex *index, struct Target *target){
+    if((index->count+1)*4 > index->cap*3){
+        struct Target **old = index->slots;
+        unsigned long oldCap = index->cap;
+        index->cap *= 2;
+        index->slots = calloc(index->cap, sizeof(struct Target *));
+        for(unsigned long i = 0; i < oldCap; i++){
+            if(old[i] != NULL){
+                unsigned long j = old[i]->nameHash & (index->cap-1);
+                while(index->slots[j] != NULL){
+                    j = (j+1) & (index->cap-1);
+                }
+                index->slots[j] = old[i];
+            }
+        }
+        free(old);
+    }
+    unsigned long i = target->nameHash & (index->cap-1);
+    while(index->slots[i] != NULL){
+        if(index->slots[i]->nameHash == target->nameHash 
+                && strcmp(index->slots[i]->targetName, target->targetName) == 0){
+            return;
+        }
+        i = (i+1) & (index->cap-1);
+    }
+    index->slots[i] = target;
+    index->count++;
+}
+
+/* Target Arena
+ * head     The head of a target list.
+ *
+ * Returns the arena of the list, for callers that build parts of
+ * the graph themselves.
+ */
+struct Arena *targetArena(struct Target *head){
+    return &getIndex(head)->arena;
+}
+
+/* Intern Name
+ * index    The index of the list the name belongs to.
+ * name     A target or dependency name.
+ *
+ * Returns the arena copy of name, making one the first time a name 
+ * is seen. Doubles the table before it gets 3/4 full.
+ */
+static char *internName(struct TargetIndex *index, const char *name){
+    if((index->nameCount+1)*4 > index->nameCap*3){
+        char **old = index->names;
+        unsigned long oldCap = index->nameCap;
+        index->nameCap *= 2;
+        index->names = calloc(index->nameCap, sizeof(char *));
+        for(unsigned long i = 0; i < oldCap; i++){
+            if(old[i] != NULL){
+                unsigned long j = hashName(old[i]) & (index->nameCap-1);
+                while(index->names[j] != NULL){
+                    j = (j+1) & (index->nameCap-1);
+                }
+                index->names[j] = old[i];
+            }
+        }
+        free(old);
+    }
+    unsigned long i = hashName(name) & (index->nameCap-1);
+    while(index->names[i] != NULL){
+        if(strcmp(index->names[i], name) == 0){
+            return index->names[i];
+        }
+        i = (i+1) & (index->nameCap-1);
+    }
+    index->names[i] = arenaCopy(&index->arena, name);
+    index->nameCount++;
+    return index->names[i];
+}
+
+/* Init Target
+ * temp     The target to set up.
+ * first    The empty rule that starts its rule list.
+ *
+ * Gives every field of a new target its starting value.
+ */
+static void initTarget(targ temp, rule first){
+    temp->ruleList = first;
 	
     temp->targetName = NULL; 
     temp->dependencies = NULL;
+
+    temp->depNames = NULL;
+    temp->depTargets = NULL;
+    temp->depCount = 0;
+    temp->dependents = NULL;
+    temp->dependentCount = 0;
+    temp->dependentCap = 0;
+    temp->pending = 0;
+    temp->inGraph = 0;
+    temp->priority = 0;
+    temp->jobWeight = 1;
+    temp->memWeight = 0;
+    temp->state = UNVISITED;
+    temp->stale = 0;
+    temp->rulesDigest = 0;
+    temp->id = 0;
+
+    temp->nameHash = 0;
+    temp->ruleTail = temp->ruleList;
+    temp->index = NULL;
 	
     temp->next = NULL;
+}
+
+/* Create Target 
+ * A constructor for the target structure. Used for the head of a 
+ * list; the targets appended to it live in the list's arena.
+ */
+targ createTarget(){
+    targ temp; 
+    temp = malloc(sizeof(struct Target));
+    initTarget(temp, createRule());
     return temp;
 }
 
@@ -33,99 +218,223 @@ rule createRule(){
     temp = malloc(sizeof(struct Rules));
     temp->next = NULL;
     temp->rulesList = NULL;
+    temp->command = NULL;
     return temp;
 }
 
-/* Is Target 
- * line     The current line from which to look for a target.
- * 
- * Iterates through the line until finding a ':' character, 
- * returns 1 if there is a target within the line, 0 if otherwise.
+/* Find Resources
+ * dependencies A target's dependency string.
+ *
+ * Returns where the word .RESOURCES starts in dependencies, or NULL
+ * if it is not there. A longer word merely containing it does not 
+ * count.
  */
-int isTarget(char *line){
-    int ans = 0;
-    for(int i = 0; i < strlen(line); i++){
-        if(!isspace(line[i]) && ans == 0){
-            ans = 1;
-        }
-        if(line[i] == ':' && ans == 1){
-            //ans = 2;
-            return 1;
+static char *findResources(char *dependencies){
+    size_t length = strlen(RESOURCES_WORD);
+    for(char *found = strstr(dependencies, RESOURCES_WORD); found != NULL; 
+            found = strstr(found+1, RESOURCES_WORD)){
+        if((found == dependencies || isspace((unsigned char)found[-1]))
+                && (found[length] == '\0' || isspace((unsigned char)found[length]))){
+            return found;
         }
     }
-    return 0;
+    return NULL;
 }
 
 /* Add Target 
  * head 	A pointer to the start of the target linked list.
- * line 	The current line from which targets and dependencies
- * 		will be pulled from. 
- *
- * This function splits up a line (not starting with a tab character)
- * into a target (the first element preceding ':') and the dependencies
- * (anything after the ':'). Also accounts for if the target is preceded
- * or followed by any form of whitespace, as long as there is ':'.
+ * name 	The target's name.
+ * dependencies	The target's dependency string.
  *
- * The function iterates to the end of the target list, allocates space
- * for a new node and then assigns variables to the new node, setting the 
- * next node in the list to be NULL.
+ * The lexer has already split the line into the target (the first
+ * word preceding ':') and the dependencies (anything after the ':'). 
+ * The name is interned and the dependencies copied into the list's 
+ * arena, then both are handed to appendTarget. A .RESOURCES word cuts
+ * the copied dependency string short, and what follows it is handed 
+ * to parseResources.
  */
-void addTarget(struct Target *head, char *line){
-    struct Target *current = head;
-    while(current-> next != NULL){
-        current = current->next; 
+void addTarget(struct Target *head, const char *name, const char *dependencies){
+    struct TargetIndex *index = getIndex(head);
+    char *copy = arenaCopy(&index->arena, dependencies);
+    char *resources = findResources(copy);
+    if(resources != NULL){
+        *resources = '\0';
+        resources += strlen(RESOURCES_WORD);
     }
-    current->next = malloc(sizeof(struct Target));
-    current->next->targetName = malloc(strlen(line)+1);
-    current->next->dependencies = malloc(strlen(line)+1);
-    current->next->ruleList = createRule();
-    
-    for(int i = 0; i < strlen(line); i++){
-        if(line[i] == ':'){
-            line[i]  = '\0';
-            int j = 0;
-            int index = -1;
-            while(j < i){
-                if(!isspace(line[j]) && index == -1){
-                    index = j;
-                }
-                if(isspace(line[j])){
-                    line[j] = '\0';
-                }
-                j++; 
-            }
-            strcpy(current->next->targetName, &line[index]);
-            strcpy(current->next->dependencies, &line[i+1]);
-        }
-    }   
-    current->next->next = NULL;
+    struct Target *target = appendTarget(head, internName(index, name), copy);
+    if(resources != NULL){
+        parseResources(target, resources);
+    }
+}
+
+/* Append Target
+ * head 	A pointer to the start of the target linked list.
+ * name 	The target's name.
+ * dependencies	The target's dependency string.
+ *
+ * Links a new node holding name and dependencies (which are not copied)
+ * after the list's tail, numbers it and enters it in the index. The 
+ * node and its empty first rule are allocated from the arena, next to
+ * the nodes before it.
+ */
+struct Target *appendTarget(struct Target *head, char *name, char *dependencies){
+    struct TargetIndex *index = getIndex(head);
+    struct Target *target = arenaAlloc(&index->arena, sizeof(struct Target));
+    initTarget(target, arenaAlloc(&index->arena, sizeof(struct Rules)));
+    target->targetName = name;
+    target->dependencies = dependencies;
+    target->nameHash = hashName(name);
+    target->id = index->size++;
+
+    index->tail->next = target;
+    index->tail = target;
+    indexInsert(index, target);
+    return target;
+}
+
+/* Append Rule
+ * head 	The head of the list target belongs to.
+ * target 	The target to add a rule to.
+ * line 	The rule line (not copied).
+ *
+ * Adds a rule node from the arena at the end of the target's rule 
+ * list, with line compiled into its command.
+ */
+void appendRule(struct Target *head, struct Target *target, char *line){
+    struct TargetIndex *index = getIndex(head);
+    struct Rules *current = arenaAlloc(&index->arena, sizeof(struct Rules));
+    current->rulesList = line;
+    current->command = compileCommand(line, &index->arena);
+    target->ruleTail->next = current;
+    target->ruleTail = current;
+}
+
+/* Count Targets
+ * head 	The head of a target list.
+ *
+ * Returns how many targets have been appended to the list.
+ */
+int countTargets(struct Target *head){
+    return head->index != NULL ? head->index->size : 0;
 }
 
 /* Add Rules
  * targHead		A pointer to the first target in the target list.
  * line	 		The current line from which rules will be assigned.
  *
- * This function iterates to the end of the target list, then iterates
- * to the end of that target node's rule list. 
- *
- * Once at the end of the rule list, it makes room for a new rule variable, 
- * and then assigns it to the contents of line, also setting next to NULL.
+ * This function finds the last target through the list's index, then 
+ * hands an arena copy of line to appendRule, which adds it after that 
+ * target node's ruleTail. 
  */
 void addRules(struct Target *targHead, char *line){
-    struct Target *currentTarg = targHead;
-    while(currentTarg-> next != NULL){
-        currentTarg = currentTarg->next; 
+    struct TargetIndex *index = getIndex(targHead);
+    appendRule(targHead, index->tail, arenaCopy(&index->arena, line));
+}
+
+/* Find Target
+ * head 	A pointer to the start of the target linked list.
+ * name 	The name of the target to look for.
+ *
+ * Probes the hash index when head has one, otherwise walks the list 
+ * comparing names. Returns the first match or NULL.
+ */
+struct Target *findTarget(struct Target *head, const char *name){
+    if(head->index != NULL){
+        struct TargetIndex *index = head->index;
+        unsigned long hash = hashName(name);
+        unsigned long i = hash & (index->cap-1);
+        while(index->slots[i] != NULL){
+            if(index->slots[i]->nameHash == hash && strcmp(index->slots[i]->targetName, name) == 0){
+                return index->slots[i];
+            }
+            i = (i+1) & (index->cap-1);
+        }
+        return NULL;
     }
-    
-    struct Rules *current = currentTarg->ruleList;
-    while(current->next != NULL){
-        current = current->next; 
+    struct Target *current = head;
+    while(current != NULL){
+        if(current->targetName != NULL && strcmp(current->targetName, name) == 0){
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+/* Add Dependent
+ * arena 	The arena of the list.
+ * depend 	The target that is depended upon.
+ * target 	The target that depends on it.
+ *
+ * Helper for buildGraph, appends target to the reverse edge
+ * list of depend, growing the array (in the arena) as needed.
+ */
+static void addDependent(struct Arena *arena, struct Target *depend, struct Target *target){
+    if(depend->dependentCount == depend->dependentCap){
+        depend->dependentCap = depend->dependentCap == 0 ? 4 : depend->dependentCap*2;
+        struct Target **grown = arenaAlloc(arena, depend->dependentCap*sizeof(struct Target *));
+        if(depend->dependentCount > 0){
+            memcpy(grown, depend->dependents, depend->dependentCount*sizeof(struct Target *));
+        }
+        depend->dependents = grown;
+    }
+    depend->dependents[depend->dependentCount++] = target;
+}
+
+/* Build Graph
+ * head 	A pointer to the start of the target linked list.
+ *
+ * Parses each target's dependency string with arg_parse (on a copy, so 
+ * the original string is left intact) and looks every name up with 
+ * findTarget, so passing the list head makes each lookup a hash probe. 
+ * Names that are not targets are kept as plain file dependencies with 
+ * a NULL entry in depTargets. Targets whose edges were already set (by 
+ * the graph cache) are left alone. The names are interned and the 
+ * arrays allocated from the list's arena.
+ */
+void buildGraph(struct Target *head){
+    struct TargetIndex *index = getIndex(head);
+    struct Target *current = head;
+    while(current != NULL){
+        if(current->dependencies != NULL && current->depNames == NULL){
+            int count = 0;
+            char *copy = malloc(strlen(current->dependencies)+1);
+            strcpy(copy, current->dependencies);
+            char **parsed = arg_parse(copy, &count);
+            char **names = arenaAlloc(&index->arena, (count+1)*sizeof(char *));
+            struct Target **depTargets = arenaAlloc(&index->arena, (count+1)*sizeof(struct Target *));
+            for(int i = 0; i < count; i++){
+                names[i] = internName(index, parsed[i]);
+                depTargets[i] = findTarget(head, names[i]);
+            }
+            free(parsed);
+            free(copy);
+            setDependencies(head, current, names, depTargets, count);
+        }
+        current = current->next;
+    }
+}
+
+/* Set Dependencies
+ * head 	The head of the list target belongs to.
+ * target 	The target whose edges are being set.
+ * names 	The dependency names.
+ * depTargets	The target each name refers to, or NULL for a file.
+ * count 	The number of dependencies.
+ *
+ * Stores the arrays on target and records target as a dependent of 
+ * each dependency target.
+ */
+void setDependencies(struct Target *head, struct Target *target, char **names, struct Target **depTargets, int count){
+    struct TargetIndex *index = getIndex(head);
+    target->depNames = names;
+    target->depTargets = depTargets;
+    target->depCount = count;
+    for(int i = 0; i < count; i++){
+        if(depTargets[i] != NULL){
+            addDependent(&index->arena, depTargets[i], target);
+        }
     }
-    current->next = malloc(sizeof(struct Rules));
-    current->next->rulesList = malloc(strlen(line)+1);
-    
-    strcpy(current->next->rulesList, line);
-    current->next->next = NULL;
 }
 
 /* Print Targets
@@ -164,16 +473,21 @@ void printRules(struct Rules *head){
 /* Free All
  * head 	A pointer to the start of a target list
  *
- * This function simply frees up all of the rule objects
- * within each node of the given target list, ensuring 
- * that every space of memory has been returned.
+ * This function frees every target, rule, command, string and
+ * edge array of the list by releasing its arena in one go, then
+ * the index tables and the head's own first rule, ensuring that 
+ * every space of memory has been returned. The head itself is 
+ * left for the caller to free.
  */
 void freeAll(struct Target *head){
-    struct Target *current = head;
-    while(current-> next != NULL){
-        free(current->ruleList);    
-        current = current->next;
+    if(head->index != NULL){
+        arenaFree(&head->index->arena);
+        free(head->index->slots);
+        free(head->index->names);
+        free(head->index);
+        head->index = NULL;
     }
-    free(current);
+    free(head->ruleList);
+    initTarget(head, NULL);
 }
 
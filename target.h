@@ -7,6 +7,20 @@
  * 
  */ 
 
+/* Target States
+ *
+ * Where a target is in the current run. A target is UNVISITED until
+ * the walk reaches it, IN_PROGRESS while its dependencies are being
+ * built (so meeting it again means a cycle), and DONE or FAILED once 
+ * it has been evaluated. 
+ */
+enum TargetState {
+    UNVISITED,
+    IN_PROGRESS,
+    DONE,
+    FAILED
+};
+
 /* Target Structure
  *
  * A linked list used to hold each target and its
@@ -21,6 +35,56 @@
 
     struct Rules *ruleList;
     struct Target *next; 
+
+    /* Hash of targetName, computed once when the target is added. 
+     * ruleTail is the last rule in ruleList so addRules can append 
+     * without walking the list. */
+    unsigned long nameHash;
+    struct Rules *ruleTail;
+
+    /* Only set on the head of a list: the name index of its targets
+     * (see target.c), which also remembers the last target and owns
+     * the arena everything in the list is allocated from. */
+    struct TargetIndex *index;
+
+    /* Dependency graph, filled in by buildGraph(). depTargets[i] is the
+     * target named depNames[i], or NULL when that dependency is a plain file.
+     * dependents holds the reverse edges used by the job scheduler. */
+    char **depNames;
+    struct Target **depTargets;
+    int depCount;
+
+    struct Target **dependents;
+    int dependentCount;
+    int dependentCap;
+
+    /* Scheduler bookkeeping: number of unfinished dependency targets,
+     * whether the target belongs to the subgraph of the requested goals
+     * and how early it should start (its longest chain of expected rule
+     * durations up to a goal, in nanoseconds). */
+    int pending;
+    int inGraph;
+    long long priority;
+
+    /* Declared with .RESOURCES on the target line: the job slots its 
+     * rules take (1 unless declared) and the memory they need, in 
+     * kilobytes (0 unless declared). */
+    int jobWeight;
+    long long memWeight;
+
+    /* Per-run memo: the target's state and, once it has been checked,
+     * the result of checkTime (1 if its rules had to run). */
+    enum TargetState state;
+    int stale;
+
+    /* Digest of the target's expanded rule text, used by --digests. */
+    unsigned long long rulesDigest;
+
+    /* The key its output is kept under in the --cache-dir cache. */
+    unsigned long long artifactKey;
+
+    /* Position of the target in its list, counting from 0. */
+    int id;
 };
 
 /* Rules Structure
@@ -31,6 +95,9 @@
 struct Rules {
     char *rulesList;
     struct Rules *next;
+
+    /* rulesList compiled by compileCommand when the rule is added. */
+    struct Command *command;
 };
 
 //Type definitions of the two structures.
@@ -47,39 +114,104 @@ targ createTarget();
  */
 rule createRule();
 
-/* Is Target 
- * Function that will determine if the current line contains 
- * a target, a target is any character followed by a ':'.
+/* Add Target 
+ * head 	A pointer to the start of the target linked list.
+ * name 	The target's name.
+ * dependencies	The target's dependency string.
+ *
+ * Adds a target read from a makefile line (see lexer.h). The 
+ * function copies the two parts and passes them to appendTarget.
+ * Words after a .RESOURCES word in the dependency string are not 
+ * dependencies but the target's resource weights (see resources.h),
+ * as in "link: a.o b.o .RESOURCES jobs=4 mem=6G".
  */
-int isTarget(char *line);
+void addTarget(struct Target *head, const char *name, const char *dependencies);
 
-/* Add Target 
+/* Append Target
  * head 	A pointer to the start of the target linked list.
- * line 	The current line from wich targets and dependencies
- * 		will be pulled from. 
+ * name 	The target's name.
+ * dependencies	The target's dependency string.
+ *
+ * Adds a target whose strings are already split up (and are kept, 
+ * not copied) to the end of the list and its index. Returns the new 
+ * target.
+ */
+struct Target *appendTarget(struct Target *head, char *name, char *dependencies);
+
+/* Append Rule
+ * head 	The head of the list target belongs to.
+ * target 	The target to add a rule to.
+ * line 	The rule line, which is kept, not copied.
+ *
+ * Adds a rule to the end of target's rule list, compiling the 
+ * line into a command once so it does not have to be parsed
+ * again each time it runs.
+ */
+void appendRule(struct Target *head, struct Target *target, char *line);
+
+/* Count Targets
+ * head 	The head of a target list.
  *
- * This function splits up a line (not starting with a tab character)
- * into a target (the first element preceding ':') and the dependencies
- * (anything after the ':'). 
+ * Returns the number of targets in the list.
+ */
+int countTargets(struct Target *head);
+
+/* Target Arena
+ * head 	The head of a target list.
  *
- * The function iterates to the end of the target list, allocates space
- * for a new node and then assigns variables to the new node, setting the 
- * next node in the list to be NULL.
+ * Returns the arena everything in the list is allocated from, and
+ * which freeAll releases.
  */
-void addTarget(struct Target *head, char *line);
+struct Arena *targetArena(struct Target *head);
 
 /* Add Rules
  * targHead	A pointer to the first target in the target list.
  * line	 	The current line from which rules will be assigned.
  *
- * This function iterates to the end of the target list, then iterates
- * to the end of that target node's rule list. 
- *
- * Once at the end of the rule list, it makes room for a new rule variable, 
- * and then assigns it to the contents of line, also setting next to NULL.
+ * This function appends a new rule holding a copy of line to the 
+ * rule list of the last target in the list.
  */
 void addRules(struct Target *targHead, char *line);
 
+/* Hash Name
+ * name 	The string to hash.
+ *
+ * Returns the 64-bit FNV-1a hash of name, the hash used for the
+ * target index (and by the other name-keyed tables in umake).
+ */
+unsigned long hashName(const char *name);
+
+/* Find Target
+ * head 	A pointer to the start of the target linked list.
+ * name 	The name of the target to look for.
+ *
+ * Returns the first target in the list called name, or NULL if
+ * there is no such target. When head is the list head that targets
+ * were added to, the lookup goes through its hash index.
+ */
+struct Target *findTarget(struct Target *head, const char *name);
+
+/* Build Graph
+ * head 	A pointer to the start of the target linked list.
+ *
+ * Splits every target's dependency string into names once and links
+ * each name to the target it refers to (if any), recording the reverse
+ * edge on the dependency so a scheduler can walk the graph both ways.
+ */
+void buildGraph(struct Target *head);
+
+/* Set Dependencies
+ * head 	The head of the list target belongs to.
+ * target 	The target whose edges are being set.
+ * names 	The dependency names.
+ * depTargets	For each name, the target it refers to or NULL.
+ * count 	The number of dependencies.
+ *
+ * Gives target its dependency edges and adds the matching reverse
+ * edges. Used by buildGraph and when loading a cached graph.
+ */
+void setDependencies(struct Target *head, struct Target *target, char **names, struct Target **depTargets, int count);
+
 /* Print Targets
  * head 	The start of the target linked list. 
  *
@@ -98,9 +230,10 @@ void printRules(struct Rules *head);
 /* Free All
  * head 	A pointer to the start of a target list
  *
- * This function simply frees up all of the rule objects
- * within each node of the given target list, ensuring 
- * that every space of memory has been returned.
+ * This function frees every target, rule and string of the
+ * given target list (all held in one arena), ensuring that 
+ * every space of memory has been returned. head itself is 
+ * left for the caller to free.
  */
 void freeAll(struct Target *head);
 
@@ -0,0 +1,253 @@
+/*
+ *  CS347 umaketrace.c
+ *
+ *  The file-access tracer --trace-deps loads into every rule command
+ *  with LD_PRELOAD. It wraps the calls that open files and appends a
+ *  line for each file opened to the log named by UMAKE_TRACE:
+ *    R <absolute path>     (opened for reading only)
+ *    W <absolute path>     (opened for writing)
+ *  The log is opened, written with one write() and closed again for
+ *  every line, so processes that close or reuse descriptors cannot
+ *  disturb it, and lines from several processes never mix.
+ *
+ *  build: gcc -shared -fPIC -o umaketrace.so trace/umaketrace.c -ldl
+ */
+#undef _FORTIFY_SOURCE
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dlfcn.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+/* CONSTANTS */
+
+/* The environment variable holding the log's path. */
+#define TRACE_LOG "UMAKE_TRACE"
+
+/* Base Directory
+ * dirfd    AT_FDCWD or a directory descriptor passed to openat.
+ * base     Filled in with the directory relative paths start from.
+ *
+ * Returns 0 if the directory could not be found out.
+ */
+static int baseDirectory(int dirfd, char *base){
+    if(dirfd == AT_FDCWD){
+        return getcwd(base, PATH_MAX) != NULL;
+    }
+    char link[64];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", dirfd);
+    ssize_t length = readlink(link, base, PATH_MAX - 1);
+    if(length <= 0){
+        return 0;
+    }
+    base[length] = '\0';
+    return 1;
+}
+
+/* Note
+ * dirfd    The directory a relative path is opened from.
+ * path     The path a call has just opened.
+ * reading  Whether it was opened for reading only.
+ *
+ * Appends the path's line to the log. errno is left as the wrapped
+ * call set it.
+ */
+static void note(int dirfd, const char *path, int reading){
+    const char *log = getenv(TRACE_LOG);
+    if(log == NULL || path == NULL || path[0] == '\0'){
+        return;
+    }
+    int saved = errno;
+    char line[2*PATH_MAX + 4];
+    char base[PATH_MAX];
+    int length;
+    if(path[0] == '/'){
+        length = snprintf(line, sizeof(line), "%c %s\n", reading ? 'R' : 'W', path);
+    } else if(baseDirectory(dirfd, base)){
+        length = snprintf(line, sizeof(line), "%c %s/%s\n", reading ? 'R' : 'W', base, path);
+    } else {
+        errno = saved;
+        return;
+    }
+    if(length > 0 && length < (int)sizeof(line)){
+        int fd = syscall(SYS_openat, AT_FDCWD, log, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if(fd != -1){
+            syscall(SYS_write, fd, line, length);
+            syscall(SYS_close, fd);
+        }
+    }
+    errno = saved;
+}
+
+/* Note Open
+ * dirfd    The directory a relative path is opened from.
+ * path     The path an open call was given.
+ * flags    Its flags.
+ * fd       What it returned.
+ *
+ * Directories and O_PATH descriptors are not file contents, and a
+ * failed call opened nothing, so none of them are noted.
+ */
+static void noteOpen(int dirfd, const char *path, int flags, int fd){
+    if(fd == -1 || (flags & (O_DIRECTORY | O_PATH)) != 0){
+        return;
+    }
+    note(dirfd, path, (flags & O_ACCMODE) == O_RDONLY);
+}
+
+/* Needs Mode
+ * flags    The flags of an open call.
+ *
+ * Returns whether the call was passed a mode as well.
+ */
+static int needsMode(int flags){
+    return (flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE;
+}
+
+/* Each wrapper finds the function it stands in for with dlsym, calls
+ * it, then notes what it opened. */
+
+int open(const char *path, int flags, ...){
+    static int (*real)(const char *, int, ...) = NULL;
+    mode_t mode = 0;
+    if(needsMode(flags)){
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "open");
+    }
+    int fd = real(path, flags, mode);
+    noteOpen(AT_FDCWD, path, flags, fd);
+    return fd;
+}
+
+int open64(const char *path, int flags, ...){
+    static int (*real)(const char *, int, ...) = NULL;
+    mode_t mode = 0;
+    if(needsMode(flags)){
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "open64");
+    }
+    int fd = real(path, flags, mode);
+    noteOpen(AT_FDCWD, path, flags, fd);
+    return fd;
+}
+
+int openat(int dirfd, const char *path, int flags, ...){
+    static int (*real)(int, const char *, int, ...) = NULL;
+    mode_t mode = 0;
+    if(needsMode(flags)){
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "openat");
+    }
+    int fd = real(dirfd, path, flags, mode);
+    noteOpen(dirfd, path, flags, fd);
+    return fd;
+}
+
+int openat64(int dirfd, const char *path, int flags, ...){
+    static int (*real)(int, const char *, int, ...) = NULL;
+    mode_t mode = 0;
+    if(needsMode(flags)){
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "openat64");
+    }
+    int fd = real(dirfd, path, flags, mode);
+    noteOpen(dirfd, path, flags, fd);
+    return fd;
+}
+
+/* The checked versions programs built with _FORTIFY_SOURCE call. */
+
+int __open_2(const char *path, int flags){
+    static int (*real)(const char *, int) = NULL;
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "__open_2");
+    }
+    int fd = real(path, flags);
+    noteOpen(AT_FDCWD, path, flags, fd);
+    return fd;
+}
+
+int __open64_2(const char *path, int flags){
+    static int (*real)(const char *, int) = NULL;
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "__open64_2");
+    }
+    int fd = real(path, flags);
+    noteOpen(AT_FDCWD, path, flags, fd);
+    return fd;
+}
+
+int __openat_2(int dirfd, const char *path, int flags){
+    static int (*real)(int, const char *, int) = NULL;
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "__openat_2");
+    }
+    int fd = real(dirfd, path, flags);
+    noteOpen(dirfd, path, flags, fd);
+    return fd;
+}
+
+int __openat64_2(int dirfd, const char *path, int flags){
+    static int (*real)(int, const char *, int) = NULL;
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "__openat64_2");
+    }
+    int fd = real(dirfd, path, flags);
+    noteOpen(dirfd, path, flags, fd);
+    return fd;
+}
+
+/* fopen opens its file inside the C library, where open cannot be
+ * wrapped, so it is wrapped itself. A mode with no 'w', 'a' or '+'
+ * reads only. */
+
+FILE *fopen(const char *path, const char *mode){
+    static FILE *(*real)(const char *, const char *) = NULL;
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "fopen");
+    }
+    FILE *file = real(path, mode);
+    if(file != NULL){
+        note(AT_FDCWD, path, strpbrk(mode, "wa+") == NULL);
+    }
+    return file;
+}
+
+FILE *fopen64(const char *path, const char *mode){
+    static FILE *(*real)(const char *, const char *) = NULL;
+    if(real == NULL){
+        real = dlsym(RTLD_NEXT, "fopen64");
+    }
+    FILE *file = real(path, mode);
+    if(file != NULL){
+        note(AT_FDCWD, path, strpbrk(mode, "wa+") == NULL);
+    }
+    return file;
+}
@@ -0,0 +1,483 @@
+/*
+ *  CS347 tracedeps.c
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <fcntl.h>
+#include "target.h"
+#include "statcache.h"
+#include "tracedeps.h"
+
+/* CONSTANTS */
+
+/* The number of buckets the database starts with; it doubles whenever
+ * it holds more records than buckets. */
+#define DEPS_BUCKETS 1024
+
+/* The environment variables the tracer is loaded and pointed with. */
+#define PRELOAD "LD_PRELOAD"
+#define TRACE_LOG "UMAKE_TRACE"
+
+/* Traced Structure
+ *
+ * The files one target's rules read the last time they ran traced.
+ */
+struct Traced {
+    char *name;
+    unsigned long hash;
+    char **deps;
+    int count;
+    struct Traced *next;
+};
+
+/* The database: bucketCount buckets (a power of two) of Traced chains,
+ * holding recordCount records. dirty is set once a record has been
+ * replaced in this run. */
+static struct Traced **buckets = NULL;
+static unsigned long bucketCount = 0;
+static unsigned long recordCount = 0;
+static int dirty = 0;
+
+/* The tracer's path and the working directory, set by startTracing. */
+static char *tracer = NULL;
+static char *workDir = NULL;
+
+/* Grow Buckets
+ *
+ * Allocates the first DEPS_BUCKETS buckets, or doubles the table and
+ * moves every record to its new bucket.
+ */
+static void growBuckets(){
+    unsigned long newCount = bucketCount == 0 ? DEPS_BUCKETS : 2 * bucketCount;
+    struct Traced **newBuckets = calloc(newCount, sizeof(struct Traced *));
+    for(unsigned long i = 0; i < bucketCount; i++){
+        struct Traced *current = buckets[i];
+        while(current != NULL){
+            struct Traced *next = current->next;
+            current->next = newBuckets[current->hash & (newCount - 1)];
+            newBuckets[current->hash & (newCount - 1)] = current;
+            current = next;
+        }
+    }
+    free(buckets);
+    buckets = newBuckets;
+    bucketCount = newCount;
+}
+
+/* Find Traced
+ * name     The target to look up.
+ * create   Whether to add an empty record if there is none.
+ *
+ * Returns the record for name, or NULL.
+ */
+static struct Traced *findTraced(const char *name, int create){
+    if(bucketCount == 0){
+        if(!create){
+            return NULL;
+        }
+        growBuckets();
+    }
+    unsigned long hash = hashName(name);
+    struct Traced *current = buckets[hash & (bucketCount - 1)];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->name, name) == 0){
+            return current;
+        }
+        current = current->next;
+    }
+    if(!create){
+        return NULL;
+    }
+    if(recordCount >= bucketCount){
+        growBuckets();
+    }
+    current = calloc(1, sizeof(struct Traced));
+    current->name = strdup(name);
+    current->hash = hash;
+    current->next = buckets[hash & (bucketCount - 1)];
+    buckets[hash & (bucketCount - 1)] = current;
+    recordCount++;
+    return current;
+}
+
+/* Clear Traced
+ * record   A record.
+ *
+ * Frees the dependencies of record.
+ */
+static void clearTraced(struct Traced *record){
+    for(int i = 0; i < record->count; i++){
+        free(record->deps[i]);
+    }
+    free(record->deps);
+    record->deps = NULL;
+    record->count = 0;
+}
+
+/* Add Dependency
+ * record   A record.
+ * path     A path to add to its dependencies; it is copied.
+ */
+static void addDependency(struct Traced *record, const char *path){
+    record->deps = realloc(record->deps, (record->count + 1) * sizeof(char *));
+    record->deps[record->count++] = strdup(path);
+}
+
+/* Append Line
+ * log      A trace log.
+ * kind     'R' or 'W'.
+ * path     A path, made absolute from the working directory if it is
+ *          relative.
+ *
+ * Appends a line to log in the tracer's format.
+ */
+static void appendLine(const char *log, char kind, const char *path){
+    FILE *file = fopen(log, "a");
+    if(file == NULL){
+        return;
+    }
+    if(path[0] == '/'){
+        fprintf(file, "%c %s\n", kind, path);
+    } else {
+        fprintf(file, "%c %s/%s\n", kind, workDir, path);
+    }
+    fclose(file);
+}
+
+/* Clean Path
+ * path     An absolute path from a trace log.
+ *
+ * Returns a newly allocated copy of path, resolved with realpath if it
+ * has a "." or ".." component, and relative if it lies in the working
+ * directory. Returns NULL if a path that needed resolving is gone.
+ */
+static char *cleanPath(const char *path){
+    char *clean;
+    if(strstr(path, "/./") != NULL || strstr(path, "/../") != NULL){
+        clean = realpath(path, NULL);
+        if(clean == NULL){
+            return NULL;
+        }
+    } else {
+        clean = strdup(path);
+    }
+    size_t length = strlen(workDir);
+    if(strncmp(clean, workDir, length) == 0 && clean[length] == '/' && clean[length+1] != '\0'){
+        memmove(clean, clean + length + 1, strlen(clean + length + 1) + 1);
+    }
+    return clean;
+}
+
+/* Compare Paths
+ * a, b     Pointers to two paths.
+ *
+ * Orders paths for qsort and bsearch.
+ */
+static int comparePaths(const void *a, const void *b){
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Keeps Path
+ * target   The traced target.
+ * path     A cleaned path its rules read.
+ *
+ * Returns whether path belongs among target's traced dependencies.
+ */
+static int keepsPath(struct Target *target, const char *path){
+    if(strcmp(path, target->targetName) == 0 || strncmp(path, "/proc/", 6) == 0
+            || strncmp(path, "/sys/", 5) == 0 || strncmp(path, "/dev/", 5) == 0){
+        return 0;
+    }
+    for(int i = 0; i < target->depCount; i++){
+        if(strcmp(path, target->depNames[i]) == 0){
+            return 0;
+        }
+    }
+    return statFile(path)->exists;
+}
+
+/* Start Tracing
+ *
+ * The tracer has to sit next to the executable, found through
+ * /proc/self/exe, so that it goes wherever umake is installed.
+ */
+int startTracing(){
+    char exe[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if(length <= 0){
+        return 0;
+    }
+    exe[length] = '\0';
+    char *slash = strrchr(exe, '/');
+    *slash = '\0';
+    free(tracer);
+    tracer = malloc(strlen(exe) + strlen(TRACER) + 2);
+    sprintf(tracer, "%s/%s", exe, TRACER);
+    if(access(tracer, R_OK) != 0){
+        return 0;
+    }
+    free(workDir);
+    workDir = getcwd(NULL, 0);
+    return workDir != NULL;
+}
+
+/* Open Trace Log
+ *
+ * Logs go in TMPDIR, or /tmp.
+ */
+char *openTraceLog(){
+    const char *dir = getenv("TMPDIR");
+    if(dir == NULL || dir[0] == '\0'){
+        dir = "/tmp";
+    }
+    char *path = malloc(strlen(dir) + 20);
+    sprintf(path, "%s/umake-trace-XXXXXX", dir);
+    int fd = mkostemp(path, O_CLOEXEC);
+    if(fd == -1){
+        free(path);
+        return NULL;
+    }
+    close(fd);
+    return path;
+}
+
+/* Trace Environment
+ * environment  The environment a rule line would be started with.
+ * log          The log its file accesses go to.
+ *
+ * The pointers come first in the allocation and the two new strings
+ * after them.
+ */
+char **traceEnvironment(char **environment, const char *log){
+    size_t count = 0;
+    const char *preloaded = NULL;
+    size_t nameLength = strlen(PRELOAD);
+    for(count = 0; environment[count] != NULL; count++){
+        if(strncmp(environment[count], PRELOAD "=", nameLength + 1) == 0){
+            preloaded = environment[count] + nameLength + 1;
+        }
+    }
+    size_t preloadSize = nameLength + strlen(tracer) + 2;
+    if(preloaded != NULL && preloaded[0] != '\0'){
+        preloadSize += strlen(preloaded) + 1;
+    }
+    size_t logSize = strlen(TRACE_LOG) + strlen(log) + 2;
+    char **traced = malloc((count + 3) * sizeof(char *) + preloadSize + logSize);
+    char *preload = (char *)&traced[count + 3];
+    char *logEntry = preload + preloadSize;
+    if(preloaded != NULL && preloaded[0] != '\0'){
+        sprintf(preload, "%s=%s %s", PRELOAD, tracer, preloaded);
+    } else {
+        sprintf(preload, "%s=%s", PRELOAD, tracer);
+    }
+    sprintf(logEntry, "%s=%s", TRACE_LOG, log);
+
+    size_t used = 0;
+    for(size_t i = 0; i < count; i++){
+        if(strncmp(environment[i], PRELOAD "=", nameLength + 1) != 0
+                && strncmp(environment[i], TRACE_LOG "=", strlen(TRACE_LOG) + 1) != 0){
+            traced[used++] = environment[i];
+        }
+    }
+    traced[used++] = preload;
+    traced[used++] = logEntry;
+    traced[used] = NULL;
+    return traced;
+}
+
+/* Trace Redirects
+ * log          The log of the line's target.
+ * redirects    The line's redirections.
+ * count        The number of redirections.
+ */
+void traceRedirects(const char *log, struct Redirect *redirects, int count){
+    for(int i = 0; i < count; i++){
+        appendLine(log, (redirects[i].flags & O_ACCMODE) == O_RDONLY ? 'R' : 'W',
+                redirects[i].file);
+    }
+}
+
+/* Collect Trace
+ * target   A target whose rules have all succeeded.
+ * log      The log they were traced into.
+ *
+ * The reads and the writes are sorted, so that each path is kept once
+ * and writes are found with bsearch.
+ */
+void collectTrace(struct Target *target, char *log){
+    FILE *file = fopen(log, "r");
+    if(file == NULL){
+        discardTrace(log);
+        return;
+    }
+    char **paths[2] = {NULL, NULL};
+    int counts[2] = {0, 0};
+    int caps[2] = {0, 0};
+    size_t  bufsize = 0;
+    char*   line    = NULL;
+    ssize_t linelen;
+    while((linelen = getline(&line, &bufsize, file)) != -1){
+        if(linelen > 0 && line[linelen-1] == '\n'){
+            line[linelen-1] = '\0';
+        }
+        if((line[0] != 'R' && line[0] != 'W') || line[1] != ' ' || line[2] != '/'){
+            continue;
+        }
+        int kind = line[0] == 'W';
+        char *path = cleanPath(&line[2]);
+        if(path == NULL){
+            continue;
+        }
+        if(counts[kind] == caps[kind]){
+            caps[kind] = caps[kind] == 0 ? 64 : 2 * caps[kind];
+            paths[kind] = realloc(paths[kind], caps[kind] * sizeof(char *));
+        }
+        paths[kind][counts[kind]++] = path;
+    }
+    free(line);
+    fclose(file);
+    discardTrace(log);
+
+    for(int kind = 0; kind < 2; kind++){
+        if(counts[kind] > 0){
+            qsort(paths[kind], counts[kind], sizeof(char *), comparePaths);
+        }
+    }
+    struct Traced *record = findTraced(target->targetName, 1);
+    clearTraced(record);
+    for(int i = 0; i < counts[0]; i++){
+        char *path = paths[0][i];
+        if((i > 0 && strcmp(path, paths[0][i-1]) == 0)
+                || (counts[1] > 0 
+                    && bsearch(&path, paths[1], counts[1], sizeof(char *), comparePaths) != NULL)){
+            continue;
+        }
+        if(keepsPath(target, path)){
+            addDependency(record, path);
+        }
+    }
+    dirty = 1;
+
+    for(int kind = 0; kind < 2; kind++){
+        for(int i = 0; i < counts[kind]; i++){
+            free(paths[kind][i]);
+        }
+        free(paths[kind]);
+    }
+}
+
+/* Discard Trace
+ * log      A log, or NULL.
+ */
+void discardTrace(char *log){
+    if(log != NULL){
+        unlink(log);
+        free(log);
+    }
+}
+
+/* Traced Dependencies
+ * name     A target name.
+ * count    Set to the number of dependencies.
+ *
+ * While the database is empty nothing is looked up.
+ */
+char **tracedDeps(const char *name, int *count){
+    struct Traced *record = recordCount != 0 ? findTraced(name, 0) : NULL;
+    *count = record != NULL ? record->count : 0;
+    return record != NULL ? record->deps : NULL;
+}
+
+/* Load Dependency Database
+ * path     The database file.
+ *
+ * The file is plain text, one record per line:
+ *   T <name>
+ *   I <path>          (one per dependency, after its T line)
+ */
+void loadDepDb(const char *path){
+    FILE *db = fopen(path, "r");
+    if(db == NULL){
+        return;
+    }
+    size_t  bufsize = 0;
+    char*   line    = NULL;
+    ssize_t linelen;
+    struct Traced *current = NULL;
+    while((linelen = getline(&line, &bufsize, db)) != -1){
+        if(linelen > 0 && line[linelen-1] == '\n'){
+            line[linelen-1] = '\0';
+        }
+        if(strncmp(line, "T ", 2) == 0 && line[2] != '\0'){
+            current = findTraced(&line[2], 1);
+            clearTraced(current);
+        } else if(strncmp(line, "I ", 2) == 0 && line[2] != '\0' && current != NULL){
+            addDependency(current, &line[2]);
+        }
+    }
+    free(line);
+    fclose(db);
+}
+
+/* Save Dependency Database
+ * path     The database file.
+ *
+ * Writes the records in the format read by loadDepDb.
+ */
+int saveDepDb(const char *path){
+    if(!dirty){
+        return 0;
+    }
+    char temp[strlen(path)+5];
+    sprintf(temp, "%s.tmp", path);
+    FILE *db = fopen(temp, "w");
+    if(db == NULL){
+        perror(temp);
+        return -1;
+    }
+    for(unsigned long i = 0; i < bucketCount; i++){
+        for(struct Traced *record = buckets[i]; record != NULL; record = record->next){
+            fprintf(db, "T %s\n", record->name);
+            for(int j = 0; j < record->count; j++){
+                fprintf(db, "I %s\n", record->deps[j]);
+            }
+        }
+    }
+    if(fclose(db) != 0 || rename(temp, path) != 0){
+        perror(path);
+        return -1;
+    }
+    dirty = 0;
+    return 0;
+}
+
+/* Free Dependency Database
+ *
+ * Frees every record, the buckets and the paths startTracing found.
+ */
+void freeDepDb(){
+    for(unsigned long i = 0; i < bucketCount; i++){
+        struct Traced *current = buckets[i];
+        while(current != NULL){
+            struct Traced *next = current->next;
+            clearTraced(current);
+            free(current->name);
+            free(current);
+            current = next;
+        }
+    }
+    free(buckets);
+    buckets = NULL;
+    bucketCount = 0;
+    recordCount = 0;
+    dirty = 0;
+    free(tracer);
+    free(workDir);
+    tracer = NULL;
+    workDir = NULL;
+}
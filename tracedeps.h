@@ -0,0 +1,106 @@
+#ifndef __TRACEDEPS__H__
+#define __TRACEDEPS__H__
+/*
+ *  CS347 tracedeps.h
+ *
+ */
+
+#include "target.h"
+#include "arg_parse.h"
+
+/* The dependency database kept in the working directory by
+ * --trace-deps. */
+#define TRACE_DB ".umake.deps"
+
+/* The tracer, looked for next to the umake executable. */
+#define TRACER "umaketrace.so"
+
+/* Start Tracing
+ *
+ * Finds the tracer and the directory traced paths are made relative
+ * to. Returns 0 if there is no tracer.
+ */
+int startTracing();
+
+/* Open Trace Log
+ *
+ * Creates an empty log for the rules of one target to be traced into.
+ * Returns its path, to be passed to collectTrace or discardTrace, or
+ * NULL if it could not be created.
+ */
+char *openTraceLog();
+
+/* Trace Environment
+ * environment  The environment a rule line would be started with.
+ * log          The log its file accesses go to.
+ *
+ * Returns a copy of environment that loads the tracer, in front of any
+ * library LD_PRELOAD already names, and points it at log. The copy is
+ * a single allocation, freed with free().
+ */
+char **traceEnvironment(char **environment, const char *log);
+
+/* Trace Redirects
+ * log          The log of the line's target.
+ * redirects    The line's redirections.
+ * count        The number of redirections.
+ *
+ * Notes the files the redirections open in log. They are opened
+ * before the command starts, so the tracer never sees them.
+ */
+void traceRedirects(const char *log, struct Redirect *redirects, int count);
+
+/* Collect Trace
+ * target   A target whose rules have all succeeded.
+ * log      The log they were traced into.
+ *
+ * Replaces the dependencies recorded for target with the files its
+ * rules read: every path read that still exists, less the target
+ * itself, its declared dependencies, anything the rules wrote and
+ * anything under /proc, /sys or /dev. Paths in the working directory
+ * are made relative, so they match target names. The log is removed
+ * and log freed.
+ */
+void collectTrace(struct Target *target, char *log);
+
+/* Discard Trace
+ * log      A log, or NULL.
+ *
+ * Removes the log of rules that failed or were stopped, and frees log.
+ * The dependencies recorded before are kept.
+ */
+void discardTrace(char *log);
+
+/* Traced Dependencies
+ * name     A target name.
+ * count    Set to the number of dependencies.
+ *
+ * Returns the dependencies recorded for name the last time its rules
+ * ran traced, or NULL if there are none.
+ */
+char **tracedDeps(const char *name, int *count);
+
+/* Load Dependency Database
+ * path     The database file.
+ *
+ * Reads the dependencies recorded by earlier runs. A missing file
+ * leaves the database empty.
+ */
+void loadDepDb(const char *path);
+
+/* Save Dependency Database
+ * path     The database file.
+ *
+ * Writes every record to a temporary file and renames it over path,
+ * but only if something was recorded since the database was loaded.
+ * Returns 0 on success, -1 on failure.
+ */
+int saveDepDb(const char *path);
+
+/* Free Dependency Database
+ *
+ * Frees every record held in memory.
+ */
+void freeDepDb();
+
+#endif
@@ -1,507 +1,2177 @@
-/* CSCI 347 micro-make
- * 
- * 09 AUG 2017, Aran Clauson
- *
- * 10/05/2018 Chris Miller
- *
- */
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/wait.h>
-#include <string.h> 
-#include <ctype.h>
-#include "arg_parse.h"
-#include "target.h"
-
-#include <time.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <fcntl.h>
-
-/* CONSTANTS */
-
-#define BUFFER 1024
-
-/* PROTOTYPES */
-
-/* IO Redirection 
- * args     A parsed line of rules to be passed into execvp
- * 
- * The ioRedirection function takes in a args and parses through it, 
- * looking for any characters that indicate a need to redirect I/O. 
- * 
- * Does nothing if there is no need to redirect I/O.
- */
-void ioRedirection(char **args);
-
-/* Check Time 
- * name     The name of the target we are going to compare 
- * head     The current node of a target linked list
- * 
- * checkTime compares the original target's last modified time to 
- * the current dependencie's last modified time and returns 0 if 
- * the target is newer than the dependencies and 1 if at least 
- * one of the dependencies is newer than the target.
- * 
- * Returns 0 if a target has no dependencies and is up to date. 
- */
-int checkTime(char *name, struct Target *head);
-
-/* Execute Dependencies 
- * head     The current node of a target linked list
- * 
- * execDepends recursively calls itself until the current target's
- * dependencies either don't match any given targets, or the current
- * target has no dependencies. 
- * 
- * It then works its way back up to the original target, calling 
- * each dependency target in reverse order.
- */ 
-void execDepends(struct Target *head);
-
-/* Expand
- * orig    	The input string that may contain variables to be expanded
- * new     	An output buffer that will contain a copy of orig with all 
- *         	variables expanded
- * newsize 	The size of the buffer pointed to by new.
- * 
- * Expand searches through a string for a variable to be expanded (starting
- * with ${ and ending with }). It then searches the environment for that 
- * expanded variable, then replaces the current with the new.
- *
- * Example: "Hello, ${PLACE}" will expand to "Hello, World" when the environment
- * variable PLACE="World". 
- */
-int expand(char* orig, char* new, int newsize);
-
-/* Execute Rules 
- * argc    A count of command-line arguments 
- * argv    The command-line argument valus
- * head    The first element in the Target linked list
- * 
- * This function takes in linked list of targets and their corresponding 
- * rules, then it iterates through target and compares them with the user 
- * input provided by argv. 
- * 
- * If the input matches the target name, the target's rules are then 
- * executed. Otherwise, no matching input will move onto the next user
- * input. (Currently no dependence integration)
- */
-void executeRules(int argc, const char* argv[], struct Target *head);
-
-/* Process Line
- * line    The command line to execute.
- * 
- * This function interprets line as a command line.  It creates a new child
- * process to execute the line and waits for that process to complete. 
- */
-void processline(char* line);
-
-/* Main entry point.
- * argc    A count of command-line arguments 
- * argv    The command-line argument valus
- *
- * Micro-make (umake) reads from the uMakefile in the current working
- * directory.  The file is read one line at a time.  Lines with a leading tab
- * character ('\t') are interpreted as a command and passed to processline minus
- * the leading tab.
- */
-int main(int argc, const char* argv[]) {
-
-  FILE* makefile = fopen("./uMakefile", "r");
-  if(makefile == NULL){
-        fprintf(stderr, "ERROR: Could not find uMakefile.\n");
-        exit(1);
-  }
-  
-  size_t  bufsize = 0;
-  char*   line    = NULL;
-  ssize_t linelen = getline(&line, &bufsize, makefile);
-
-  struct Target *targets = createTarget();
-  
-  while(-1 != linelen) {
-
-    if(line[linelen-1]=='\n') {
-      linelen -= 1;
-      line[linelen] = '\0';
-    }
-
-    for(int i = 0; i < strlen(line); i++){
-        if(line[i] == '#'){
-            line[i] = '\0';
-        }
-    }
-	
-    if(isTarget(line) == 1 && line[0] != '\0'){
-        addTarget(targets, &line[0]);
-    } else if (isTarget(line) != 1 && line[0] != '\t'){
-        char* name = malloc(strlen(line));
-        char* value = malloc(strlen(line));
-        for(int i = 0; i < strlen(line); i++){
-            if(line[i] == '='){
-                line[i] = '\0';
-                strcpy(name, line);
-                strcpy(value, &line[i+1]);
-                setenv(name, value, 1);
-            }
-        }
-        free(name);
-        free(value);
-    } else if(line[0] == '\t'){
-        addRules(targets, &line[0]);
-    } 
-	
-    linelen = getline(&line, &bufsize, makefile);
-  }
-  executeRules(argc, argv, targets->next);
-  
-  freeAll(targets);
-  free(targets);
-  free(line);
-  
-  return EXIT_SUCCESS;
-}
-
-/* Process Linestat(name, &targStat) != 0
- * Creates a child process that calls arg_parse in order to split up the arguments in 'line', 
- * then uses execvp to execute the new child process, also calls the ioRedirection function in
- * the case that I/O needs to be redirected based on the rules of the target.
- */
-void processline (char* line) {
-  int count = 0;
-  char new[BUFFER];
-  char** args;
-  
-  if(expand(line, new, BUFFER) == 1){
-	args = arg_parse(new, &count);
-  }  
-  else{ 
-	args = arg_parse(line, &count);
-  } 
- 
-  if(count != 0){
-    const pid_t cpid = fork();
-    switch(cpid) {
-        
-        case -1: {
-            perror("fork");
-            free(args);
-            break;
-        }
-
-        case 0: {
-            ioRedirection(args);
-     
-            execvp(*args, args);
-            perror("execvp");
-            free(args);
-            exit(EXIT_FAILURE);
-            break;
-        }
-
-        default: {
-            int   status;
-            const pid_t pid = wait(&status);
-            if(-1 == pid) {
-            perror("wait");
-            }
-            else if (pid != cpid) {
-                fprintf(stderr, "wait: expected process %d, but waited for process %d",
-                    cpid, pid);
-            }
-            break;
-        }
-    }
-
-  }
-  free(args);
-}
-
-/* IO Redirection 
- * args     A parsed line of rules to be passed into execvp
- * 
- * The ioRedirection function takes in a args and parses through it, 
- * looking for any characters that indicate a need to redirect I/O. 
- * 
- * If one of the IO characters is seen (>, >>, <), then uses open() 
- * in conjunction with dup2() to handle redirection of the I/O streams, 
- * lastly calling execvp() before exiting. 
- * 
- * Does nothing if there is no need to redirect I/O.
- */
-void ioRedirection(char **args){
-    for(int i = 0; args[i]!= NULL; i++){
-        if(strcmp(args[i], ">") == 0){// Truncate 
-            int output = open(args[i+1], O_TRUNC | O_WRONLY | O_CREAT, 0644); 
-            args[i] = NULL;
-            
-            dup2(output, 1); 
-            close(output);
-            
-            execvp(*args, args);
-            perror("execvp");
-            free(args);
-            exit(EXIT_FAILURE);
-            break;
-        }
-
-        if(strcmp(args[i], "<") == 0){// Input
-            int input = open(args[i+1], O_RDONLY);
-            args[i] = NULL;
-            dup2(input, 0);
-            
-            for(int j = i+1; args[j] != NULL; j++){
-                if(strcmp(args[j], ">") == 0){// Input and Truncate 
-                    int output = open(args[j+1], O_TRUNC | O_WRONLY | O_CREAT, 0644); 
-                    args[j] = NULL;
-                    
-                    dup2(output, 1);
-                    close(output);
-                    close(input);
-                    
-                    execvp(*args, args);
-                    perror("execvp");
-                    free(args);
-                    exit(EXIT_FAILURE);
-                    break;
-                }
-                if(strcmp(args[j], ">>") == 0){// Input and Append 
-                    int output = open(args[j+1], O_WRONLY | O_APPEND | O_CREAT, 0644);
-                    args[i] = NULL;
-                    
-                    dup2(output, 1); 
-                    close(output);
-                    close(input);
-                    
-                    execvp(*args, args);
-                    perror("execvp");
-                    free(args);
-                    exit(EXIT_FAILURE);
-                    break;
-                }
-            }	
-            close(input);
-            
-            execvp(*args, args);
-            perror("execvp");
-            free(args);
-            exit(EXIT_FAILURE);
-            break;
-        }
-
-        if(strcmp(args[i], ">>") == 0){//Append
-            int output = open(args[i+1], O_WRONLY | O_APPEND | O_CREAT, 0644);
-            args[i] = NULL;
-            
-            dup2(output, 1);
-            close(output);
-
-            execvp(*args, args);
-            perror("execvp");
-            free(args);
-            exit(EXIT_FAILURE);
-            break;
-        }
-    }
-}
-
-/* Execute Rules
- * argc		The number of arguments in the command line.
- * argv[] 	The arguments entered in the command line.
- * head		The start of a target linked list. 
- *
- * Iterates through the target linked list, comparing the target name to 
- * the user input. 
- * 
- * If the two match, then the given target's rules are executed. If the
- * current user input does not match any targets in the list, move onto
- * the next user input.
- */
-void executeRules(int argc, const char* argv[], struct Target *head){
-    int i = 1; 
-    struct Target *targList = head;
-    while(i < argc){  
-        if(strcmp(argv[i],targList->targetName) == 0){
-            execDepends(targList);
-            int flag = checkTime(targList->targetName, targList);
-            if(flag == 1){
-                struct Rules *current = targList->ruleList;
-                while(current != NULL){
-                    if(current->rulesList != NULL){
-                        char *line = malloc(strlen(current->rulesList)+1);
-                        strcpy(line, current->rulesList);
-                        processline(line);
-                        free(line);
-                    }
-                    current = current->next;
-                }
-                i++;
-                targList = head;
-            }
-        }
-        if(targList->next == NULL){
-            i++;
-            targList = head;
-        }	
-        targList = targList->next;
-    }
-}
-
-/* Expand
- * orig    	The input string that may contain variables to be expanded
- * new     	An output buffer that will contain a copy of orig with all 
- *         	variables expanded
- * newsize 	The size of the buffer pointed to by new.
- *
- * Expand returns 1 upon a successfull expand or 0 upon failure. 
- */ 
-int expand(char* orig, char* new, int newsize){
-    char temp[newsize]; 
-    char restOf[newsize];
-    char tempOrig[newsize];
-    strcpy(tempOrig, orig);
-  
-    int j = 0;
-    int start = 0; 
-    int end = 0;
-    int endOfIndex = 0;
-    int flag = 0;
-    for(int i = 0; tempOrig[i] != '\0'; i++){
-        if(tempOrig[i] == '$' && tempOrig[i+1] == '{'){
-            i+=2;
-            start = i;            
-            while(tempOrig[i] != '}' && tempOrig[i] != '\0'){
-                i++;
-                j++;
-            }
-            if(tempOrig[i] == '}'){
-                flag = 1;
-                end = j;
-                endOfIndex = i+1;             
-                strncpy(temp, &tempOrig[start], end);
-                temp[end] = '\0';
-				
-                strcpy(restOf, &tempOrig[endOfIndex]);
-                char *expanded = getenv(temp);
-                if(expanded != NULL) {
-                    if(strlen(expanded) > BUFFER){
-                        fprintf(stderr, "ERROR: Buffer Overflow \n");
-                        exit(0);
-                    }
-                    strncpy(new, tempOrig, start-2);
-                    new[start-2] = '\0';
-                    strcpy(&new[start-2], expanded);
-                    new[strlen(new)+1] = '\0';
-
-                    strcpy(&new[strlen(new)], restOf); 
-                    new[strlen(new)+1] = '\0';              
-                    strcpy(tempOrig, new);
-                } else if(expanded == NULL){
-                    strncpy(new, tempOrig, start-2); 
-                    new[start-2] = '\0';
-                    
-                    strcpy(&new[strlen(new)], restOf);
-                    strcpy(tempOrig, new);
-                    i = start-1; 
-                }
-                j = 0;
-                start = 0; 
-                end = 0;
-                endOfIndex = 0;
-            }			
-        }   
-    }
-    if(start != 0 && flag == 0){
-        fprintf(stderr, "ERROR: Mismatched braces \n");
-        exit(0); 
-    } else if(start == 0 && flag == 0){
-        return 0;
-    }
-    return 1;
-}
-
-/* Execute Dependencies 
- * head     The current node of a target linked list
- * 
- * execDepends recursively calls itself until the current target's
- * dependencies either don't match any given targets, or the current
- * target has no dependencies. 
- * 
- * It then works its way back up to the original target, calling 
- * each dependency target in reverse order.
- */ 
-void execDepends(struct Target *head){
-    struct Target *targList = head;
-    int dependCount = 0;
-    char string[strlen(targList->dependencies)];
-    strcpy(string, targList->dependencies);
-	
-    char** depen = arg_parse(string, &dependCount);
-	
-    for(int i = 0; i < dependCount; i++){
-        struct Target *tempList = head; 
-        while(tempList != NULL){
-            if(strcmp(depen[i], tempList->targetName) == 0){
-                struct Rules *tempRules = tempList->ruleList; 
-                if(tempList->dependencies != NULL){
-                    execDepends(tempList);
-                }
-                while(tempRules != NULL){
-                    if(tempRules->rulesList != NULL){
-                        int flag = checkTime(tempList->targetName, tempList);
-                        if(flag == 1){
-                            char *line = malloc(strlen(tempRules->rulesList)+1);
-                            strcpy(line, tempRules->rulesList);
-                            processline(line);
-                            free(line);
-                        }
-                    }   
-                    tempRules = tempRules->next;
-                }       
-            }
-            tempList = tempList->next;
-        }
-    }
-}
-
-/* Check Time 
- * name     The name of the target we are going to compare 
- * head     The current node of a target linked list
- * 
- * checkTime compares the original target's last modified time to 
- * the current dependencie's last modified time and returns 0 if 
- * the target is newer than the dependencies and 1 if at least 
- * one of the dependencies is newer than the target.
- * 
- * If a target has no dependencies and it is up to date, 
- * 0 is returned. 
- */
-int checkTime(char *name, struct Target *head){
-    struct Target *targList = head;
-    int dependCount = 0;
-    char string[strlen(targList->dependencies)];
-    strcpy(string, targList->dependencies);
-    char** depen = arg_parse(string, &dependCount); 
-	
-    struct stat targStat; 
-    stat(name, &targStat);
-    time_t time1 = targStat.st_mtime;
-    
-    if(dependCount == 0 && stat(name, &targStat) == 0){
-        return 0;
-    } else if(stat(name, &targStat) != 0){
-        return 1;
-    }
-    for(int i = 0; depen[i] != NULL; i++){		
-        struct stat depenStat;	
-        stat(depen[i], &depenStat);
-
-        time_t time2 = depenStat.st_mtime;
-        if(difftime(time1, time2) < 0){
-            return 1;
-        }
-    }	
-    return 0;
-}
+/* CSCI 347 micro-make
+ * 
+ * 09 AUG 2017, Aran Clauson
+ *
+ * 10/05/2018 Chris Miller
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <string.h> 
+#include <ctype.h>
+#include "arg_parse.h"
+#include "target.h"
+#include "statcache.h"
+#include "builddb.h"
+#include "graphcache.h"
+#include "builtins.h"
+#include "command.h"
+#include "lexer.h"
+#include "variables.h"
+#include "watch.h"
+#include "artifacts.h"
+#include "history.h"
+#include "jobserver.h"
+#include "output.h"
+#include "resources.h"
+#include "tracedeps.h"
+
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <errno.h>
+
+/* CONSTANTS */
+
+#define MAKEFILE "./uMakefile"
+
+/* The initial size of the explicit stacks used to walk the graph. */
+#define STACK_START 64
+
+/* How many epoll events waitChild takes at once, how often (in 
+ * milliseconds) it checks on a child it has no pidfd for, and how often
+ * the load and free memory are read again while a job waits for them. */
+#define EVENT_BATCH 64
+#define WAIT_FALLBACK 50
+#define LIMIT_RECHECK 250
+
+/* OPTIONS */
+
+/* Set by --digests: decide rebuilds from the content digests kept in 
+ * the build database instead of from modification times alone. */
+static int useDigests = 0;
+
+/* Cleared by --no-graph-cache: load the parsed graph from GRAPH_CACHE
+ * when it matches the uMakefile, and write it there when it does not. */
+static int useGraphCache = 1;
+
+/* Cleared by --no-builtins: run echo, touch, mv, cp, rm and mkdir 
+ * inside umake rather than spawning them. */
+static int useBuiltins = 1;
+
+/* Set by --watch: after the first build, keep the graph in memory and 
+ * rebuild whatever a change to one of its files affects. */
+static int watchMode = 0;
+
+/* Set by --cache-dir: the directory outputs are stored in, keyed by 
+ * their rules and inputs, and restored from instead of running rules. */
+static const char *cacheDir = NULL;
+
+/* Set by --stats: report how long each phase took (see printPhaseStats). */
+static int printStats = 0;
+
+/* Set by -k/--keep-going: when a target's rules fail, go on building 
+ * everything that does not depend on it, instead of stopping the build
+ * (and killing the jobs still running). */
+static int keepGoing = 0;
+
+/* Set by --output-sync: what parallelRules does with the output of the
+ * jobs it runs (see enum OutputMode). */
+static enum OutputMode outputMode = OUTPUT_NONE;
+
+/* Set by -l/--max-load: a parallel build starts no further job while 
+ * the system's load is at or above this (0 for no limit). */
+static double maxLoad = 0;
+
+/* Set by --max-mem: the most memory, in kilobytes, the running targets
+ * of a parallel build may have declared with .RESOURCES together (0 for
+ * no limit). */
+static long long maxMemory = 0;
+
+/* Set by --restat: once a target's rules have run, look at whether 
+ * they left its file as it was (untouched, or written again byte for 
+ * byte), and if so do not rebuild what depends on it on its account 
+ * (see noteOutput). */
+static int restat = 0;
+
+/* Set by --trace-deps: run every rule line with the file-access tracer
+ * and check the files a target's rules read last time along with its 
+ * declared dependencies (see collectTrace). */
+static int traceDeps = 0;
+
+/* Set when more than one job may run or --restat is given: load the 
+ * history from HISTORY_FILE and save it back afterwards. Only the 
+ * parallel scheduler reads the durations in it and only --restat the 
+ * times, so a plain serial build leaves no file behind. */
+static int useHistory = 0;
+
+static struct option longOptions[] = {
+    {"jobs",    required_argument, NULL, 'j'},
+    {"digests", no_argument,       NULL, 'D'},
+    {"no-graph-cache", no_argument, NULL, 'G'},
+    {"no-builtins", no_argument,   NULL, 'B'},
+    {"watch",   no_argument,       NULL, 'w'},
+    {"cache-dir", required_argument, NULL, 'C'},
+    {"stats",   no_argument,       NULL, 'S'},
+    {"output-sync", required_argument, NULL, 'O'},
+    {"max-load", required_argument, NULL, 'l'},
+    {"keep-going", no_argument,    NULL, 'k'},
+    {"max-mem", required_argument, NULL, 'M'},
+    {"restat",  no_argument,       NULL, 'R'},
+    {"trace-deps", no_argument,    NULL, 'T'},
+    {NULL, 0, NULL, 0}
+};
+
+/* STATS */
+
+/* Seconds spent loading the targets (parsing the uMakefile or mapping 
+ * the graph cache), linking the graph, saving the graph cache and 
+ * building the goals, and whether the graph cache was used. */
+static double loadSeconds = 0;
+static double graphSeconds = 0;
+static double saveSeconds = 0;
+static double buildSeconds = 0;
+static int loadedFromCache = 0;
+
+/* PROTOTYPES */
+
+/* IO Redirection 
+ * redirects  The redirections found in a parsed line by parseRedirections
+ * count      The number of redirections
+ * actions    The file actions of the child that will run the line
+ * 
+ * The ioRedirection function turns the redirections of a line into 
+ * file actions for posix_spawnp. 
+ * 
+ * Does nothing if there is no need to redirect I/O.
+ */
+void ioRedirection(struct Redirect *redirects, int count, posix_spawn_file_actions_t *actions);
+
+/* Check Time 
+ * name     The name of the target we are going to compare 
+ * head     The current node of a target linked list
+ * 
+ * checkTime compares the original target's last modified time to 
+ * the current dependencie's last modified time and returns 0 if 
+ * the target is newer than the dependencies and 1 if at least 
+ * one of the dependencies is newer than the target.
+ * 
+ * Returns 0 if a target has no dependencies and is up to date. 
+ */
+int checkTime(char *name, struct Target *head);
+
+/* Needs Rebuild
+ * target   A target whose dependencies are up to date.
+ * 
+ * Decides whether target's rules have to run: checkTime normally, or 
+ * with --digests a comparison against the build database (falling 
+ * back to checkTime for targets the database has not seen yet).
+ */
+int needsRebuild(struct Target *target);
+
+/* Rules Digest
+ * target   The target whose rules should be digested.
+ * 
+ * Returns a digest of the target's rule lines after variable expansion.
+ */
+unsigned long long rulesDigest(struct Target *target);
+
+/* Run Target Rules
+ * target   The target whose rules should be executed.
+ * trace    The log to trace them into, or NULL.
+ * 
+ * Passes each of the target's compiled rules to processline, stopping
+ * at the first one that fails. Returns 0 if all of them succeeded, -1 
+ * (once the failure is reported) otherwise.
+ */
+int runTargetRules(struct Target *target, const char *trace);
+
+/* Restore Target
+ * target   A target whose rules need to run.
+ * 
+ * With --cache-dir, looks the target's output up in the artifact cache
+ * and restores it. Returns 1 if the rules no longer need to run.
+ */
+int restoreTarget(struct Target *target);
+
+/* Store Target
+ * target   A target whose rules have just run.
+ * 
+ * With --cache-dir, copies the target's output into the artifact cache.
+ */
+void storeTarget(struct Target *target);
+
+/* Execute Rules 
+ * roots    The goal targets, each listed once.
+ * count    The number of goal targets.
+ * 
+ * Brings every goal up to date in one depth-first walk: each target's
+ * dependencies are built first, left to right, then its time is 
+ * checked and its rules run if needed. Every target is evaluated 
+ * exactly once per run, however many goals reach it: the result is 
+ * remembered in the target's state. The walk keeps its own stack, so
+ * chains of any depth build in bounded stack space, and a cycle is 
+ * reported with its full path. When a target's rules fail, the walk 
+ * stops there, unless -k was given: then only the targets depending 
+ * on the failed one are skipped.
+ * 
+ * Returns the number of goals that could not be built.
+ */
+int executeRules(struct Target **roots, int count);
+
+/* Parallel Rules
+ * roots    The goal targets, each listed once.
+ * count    The number of goal targets.
+ * head     The head of the Target linked list
+ * jobs     The maximum number of rule lines to run at once
+ * 
+ * Builds the union of the subgraphs reachable from the goals, then keeps 
+ * a queue of targets whose dependencies are all finished. Up to jobs 
+ * targets have their rules running at the same time, each target running 
+ * its own rule lines in order. A target declaring jobs=N in .RESOURCES 
+ * counts as N of them, and a new target only starts while the load and
+ * memory limits (--max-load, --max-mem) leave room for it. When a 
+ * target's rules fail, the build stops and the jobs still running are
+ * killed, unless -k was given: then only the targets depending on the 
+ * failed one are skipped.
+ * 
+ * Returns the number of goals that could not be built.
+ */
+int parallelRules(struct Target **roots, int count, struct Target *head, int jobs);
+
+/* Run Goals
+ * goalc    The number of goals requested on the command line
+ * goals    The requested goal names
+ * head     The head of the Target linked list
+ * jobs     The maximum number of rule lines to run at once
+ * 
+ * Looks every goal up once (a goal named twice is built once) and 
+ * builds them all together: with parallelRules when more than one job
+ * may run, and with executeRules otherwise. Returns the number of goals
+ * that could not be built.
+ */
+int runGoals(int goalc, const char* goals[], struct Target *head, int jobs);
+
+/* Watch Rules
+ * goalc    The number of goals requested on the command line
+ * goals    The requested goal names
+ * head     The head of the Target linked list, already built once
+ * jobs     The maximum number of rule lines to run at once
+ * 
+ * Watches every file the goals depend on, and the uMakefile, with 
+ * inotify. When one changes, only the targets downstream of it are 
+ * brought up to date again; the rest of the graph and the stat cache 
+ * stay as they are. A changed uMakefile is read again. Only returns if
+ * the files cannot be watched, with the head of the current list.
+ */
+struct Target *watchRules(int goalc, const char* goals[], struct Target *head, int jobs);
+
+/* Process Line
+ * command The compiled command line to execute.
+ * trace   The log to trace the line into, or NULL.
+ * 
+ * This function runs command as a command line.  It creates a new child
+ * process to execute the line and waits for that process to complete. 
+ * Returns the wait status of the child (0 if it succeeded, or if the 
+ * line held no command), or -1 if the command could not be started or
+ * failed as a builtin.
+ */
+int processline(struct Command* command, const char *trace);
+
+/* Start Line
+ * command The compiled command line to execute.
+ * output  The job output the line's stdout and stderr go to, or NULL 
+ *         to leave them as umake's.
+ * trace   The log to trace the line into, or NULL.
+ * 
+ * Instantiates command, then spawns a child to execute it without 
+ * waiting for it. Returns the pid of the child, 0 if the line held no 
+ * command (or was run as a builtin), or -1 if the command could not 
+ * be started or, run as a builtin, failed.
+ */
+pid_t startLine(struct Command* command, struct JobOutput *output, const char *trace);
+
+/* Read Makefile
+ * path     The uMakefile.
+ * targets  The head of the target list to fill in.
+ * 
+ * Parses the makefile into targets and rules and sets its variables.
+ * Returns 0 if the makefile could not be opened.
+ */
+int readMakefile(const char* path, struct Target *targets);
+
+/* Load Targets
+ * targets  An empty target list.
+ * 
+ * Fills targets from the graph cache or, when it does not match, from 
+ * the uMakefile (saving a new cache), and links the graph. Returns 0 
+ * if there is no uMakefile.
+ */
+int loadTargets(struct Target *targets);
+
+/* Now
+ * 
+ * Returns the time of the monotonic clock in seconds.
+ */
+double now();
+
+/* Print Phase Stats
+ * targets  The head of the target list.
+ * 
+ * Prints one line to stderr with the time of each phase, the number 
+ * of targets and umake's peak resident set size, as space separated 
+ * name=value pairs so that scripts (such as bench/bench) can read it.
+ */
+void printPhaseStats(struct Target *targets);
+
+/* Main entry point.
+ * argc    A count of command-line arguments 
+ * argv    The command-line argument valus
+ *
+ * Micro-make (umake) reads from the uMakefile in the current working
+ * directory.  The file is mapped and read one line at a time.  Lines with a leading tab
+ * character ('\t') are interpreted as a command and passed to processline minus
+ * the leading tab. When the graph cache matches the uMakefile, the parsed 
+ * targets are loaded from it instead.
+ * 
+ * umake writes two files next to the uMakefile: the graph cache 
+ * (GRAPH_CACHE, unless --no-graph-cache is given) and, when more than
+ * one job may run or --restat is given, the history of how long each 
+ * target's rules took and when they last changed it (HISTORY_FILE).
+ * 
+ * Without -j, umake joins the jobserver of a parent make named in 
+ * MAKEFLAGS and takes its job limit from it; with -j greater than 1, 
+ * it starts a jobserver of its own for the builds its rules run.
+ * 
+ * umake exits with EXIT_FAILURE if any goal could not be built, or if
+ * --watch was given and watching failed (it never ends otherwise).
+ */
+int main(int argc, const char* argv[]) {
+
+  int jobs = 1;
+  int jobsGiven = 0;
+  int opt;
+  while((opt = getopt_long(argc, (char * const *)argv, "j:l:k", longOptions, NULL)) != -1){
+      switch(opt){
+          case 'j':
+              jobs = atoi(optarg);
+              jobsGiven = 1;
+              if(jobs < 1){
+                  fprintf(stderr, "ERROR: -j expects a positive number of jobs.\n");
+                  exit(1);
+              }
+              break;
+          case 'D':
+              useDigests = 1;
+              break;
+          case 'G':
+              useGraphCache = 0;
+              break;
+          case 'B':
+              useBuiltins = 0;
+              break;
+          case 'w':
+              watchMode = 1;
+              break;
+          case 'C':
+              cacheDir = optarg;
+              break;
+          case 'S':
+              printStats = 1;
+              break;
+          case 'O':
+              if(parseOutputMode(optarg) == -1){
+                  fprintf(stderr, "ERROR: --output-sync expects none, target or line.\n");
+                  exit(1);
+              }
+              outputMode = parseOutputMode(optarg);
+              break;
+          case 'l':
+              maxLoad = atof(optarg);
+              if(maxLoad <= 0){
+                  fprintf(stderr, "ERROR: --max-load expects a positive load.\n");
+                  exit(1);
+              }
+              break;
+          case 'k':
+              keepGoing = 1;
+              break;
+          case 'M':
+              maxMemory = parseSize(optarg);
+              if(maxMemory <= 0){
+                  fprintf(stderr, "ERROR: --max-mem expects a size, such as 8G.\n");
+                  exit(1);
+              }
+              break;
+          case 'R':
+              restat = 1;
+              break;
+          case 'T':
+              traceDeps = 1;
+              break;
+          default:
+              fprintf(stderr, "usage: umake [-j jobs] [-k] [-l load] [--max-mem size] [--restat] [--trace-deps] [--digests] [--no-graph-cache] [--no-builtins] [--watch] [--cache-dir dir] [--stats] [--output-sync none|target|line] [target ...]\n");
+              fprintf(stderr, "umake keeps the parsed uMakefile in %s (unless --no-graph-cache is given) and, with -j above 1 or --restat, rule times in %s.\n",
+                      GRAPH_CACHE, HISTORY_FILE);
+              exit(1);
+      }
+  }
+
+  if(!jobsGiven){
+      joinJobserver(&jobs);
+  } else if(jobs > 1){
+      startJobserver(jobs);
+  }
+
+  struct Target *targets = createTarget();
+  if(!loadTargets(targets)){
+      fprintf(stderr, "ERROR: Could not find uMakefile.\n");
+      exit(1);
+  }
+  if(useDigests){
+      loadBuildDb(BUILD_DB);
+  }
+  if(traceDeps){
+      if(!startTracing()){
+          fprintf(stderr, "ERROR: --trace-deps needs %s next to umake.\n", TRACER);
+          exit(1);
+      }
+      loadDepDb(TRACE_DB);
+  }
+  useHistory = jobs > 1 || restat;
+  if(useHistory){
+      loadHistory(HISTORY_FILE);
+  }
+  double start = now();
+  int failed = runGoals(argc - optind, &argv[optind], targets, jobs);
+  buildSeconds = now() - start;
+  if(printStats){
+      printPhaseStats(targets);
+  }
+  if(watchMode){
+      targets = watchRules(argc - optind, &argv[optind], targets, jobs);
+      failed++;
+  }
+  
+  if(useDigests){
+      saveBuildDb(BUILD_DB);
+  }
+  freeBuildDb();
+  if(traceDeps){
+      saveDepDb(TRACE_DB);
+  }
+  freeDepDb();
+  if(useHistory){
+      saveHistory(HISTORY_FILE);
+  }
+  freeHistory();
+  closeJobserver();
+  clearStatCache();
+  freeVariables();
+  freeAll(targets);
+  free(targets);
+  closeGraphCache();
+  
+  return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Read Makefile
+ * Walks the makefile line by line with the lexer, which maps the file and hands out comment-free 
+ * slices of it, so no line is copied or rescanned here. Lines naming a target are handed to 
+ * addTarget, lines with a leading tab to addRules, and any other line holding an '=' defines a 
+ * variable in umake's own table (and is also remembered for the graph cache).
+ */
+int readMakefile(const char* path, struct Target *targets){
+  struct Lexer lexer;
+  struct Line line;
+  if(!openLexer(&lexer, path)){
+    return 0;
+  }
+
+  while(nextLine(&lexer, &line)){
+    switch(line.kind){
+      case LINE_TARGET:
+        addTarget(targets, line.name, line.value);
+        break;
+      case LINE_RULE:
+        addRules(targets, line.text);
+        break;
+      case LINE_VARIABLE:
+        defineVariable(line.name, line.value);
+        cacheVariable(line.name, line.value);
+        break;
+      case LINE_EMPTY:
+        break;
+    }
+  }
+  closeLexer(&lexer);
+  return 1;
+}
+
+/* Load Targets
+ * targets  An empty target list.
+ * 
+ * The graph cache is only tried (and written) when it is in use.
+ */
+int loadTargets(struct Target *targets){
+  double start = now();
+  int cached = useGraphCache && loadGraphCache(GRAPH_CACHE, MAKEFILE, targets);
+  if(!cached && !readMakefile(MAKEFILE, targets)){
+      return 0;
+  }
+  loadSeconds = now() - start;
+  loadedFromCache = cached;
+
+  start = now();
+  buildGraph(targets);
+  graphSeconds = now() - start;
+
+  start = now();
+  if(useGraphCache && !cached){
+      saveGraphCache(GRAPH_CACHE, MAKEFILE, targets);
+  }
+  saveSeconds = now() - start;
+  return 1;
+}
+
+/* Now
+ * 
+ * CLOCK_MONOTONIC is not affected by changes to the system time.
+ */
+double now(){
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/* Print Phase Stats
+ * targets  The head of the target list.
+ * 
+ * ru_maxrss is in kilobytes on Linux.
+ */
+void printPhaseStats(struct Target *targets){
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  fprintf(stderr, "umake-stats cached=%d targets=%d load=%.6f graph=%.6f save=%.6f build=%.6f rss=%ld\n",
+          loadedFromCache, countTargets(targets), loadSeconds, graphSeconds, saveSeconds, 
+          buildSeconds, usage.ru_maxrss);
+}
+
+/* Process Line
+ * Creates a child process (through startLine) for the arguments of 'command', then uses 
+ * posix_spawnp to execute the new child process, also calls the ioRedirection function in the 
+ * case that I/O needs to be redirected based on the rules of the target. Waits for that child
+ * to complete.
+ */
+int processline (struct Command* command, const char *trace) {
+  const pid_t cpid = startLine(command, NULL, trace);
+  if(cpid <= 0){
+      return cpid;
+  }
+  int   status;
+  const pid_t pid = waitpid(cpid, &status, 0);
+  if(-1 == pid) {
+      perror("wait");
+      return -1;
+  }
+  return status;
+}
+
+/* Start Line
+ * The rule line was split into words and redirections by compileCommand when it was read, 
+ * so all that is left is to instantiateCommand, which only has work to do for words with 
+ * variables. Commands runBuiltin knows (echo, touch, ...) are run right here, in umake. 
+ * Otherwise ioRedirection turns the redirections into file actions and the command is 
+ * launched with posix_spawnp. Unlike fork, posix_spawnp does not copy umake's page tables 
+ * (glibc starts the child with CLONE_VM | CLONE_VFORK), which keeps launching cheap however 
+ * large the target graph grows. The child gets the environment built by variableEnvironment, 
+ * so the makefile's variables reach it without umake changing its own environment. The parent 
+ * does not wait, so that callers may have several children running at once and reap them 
+ * with waitpid. With a job output, the child's stdout and stderr are duplicated from the 
+ * job's pipes before the redirections are opened, so a redirection in the rule still wins, 
+ * and a builtin writes its output and its diagnostics to builtinOutput, from where 
+ * collectBuiltin takes them. A traced line is never run as a builtin, since the tracer only 
+ * sees the files of processes it is loaded into; its environment loads the tracer (see 
+ * traceEnvironment), and the files its redirections open are noted in the log here.
+ */
+pid_t startLine(struct Command* command, struct JobOutput *output, const char *trace) {
+  struct Invocation inv;
+  pid_t cpid = 0;
+  
+  if(instantiateCommand(command, &inv) != 0){
+    char **args = inv.args;
+    int status;
+
+    if(useBuiltins && trace == NULL && (command->builtin || command->words[0].hasVars)
+            && runBuiltin(args, inv.redirects, inv.redirectCount, 
+                output != NULL ? builtinOutput(output, 0) : STDOUT_FILENO,
+                output != NULL ? builtinOutput(output, 1) : STDERR_FILENO, &status)){
+        if(output != NULL){
+            collectBuiltin(output);
+        }
+        cpid = status == 0 ? 0 : -1;
+    } else {
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        if(output != NULL){
+            posix_spawn_file_actions_adddup2(&actions, output->streams[0].writeFd, STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&actions, output->streams[1].writeFd, STDERR_FILENO);
+        }
+        ioRedirection(inv.redirects, inv.redirectCount, &actions);
+        char **environment = variableEnvironment();
+        if(trace != NULL){
+            traceRedirects(trace, inv.redirects, inv.redirectCount);
+            environment = traceEnvironment(environment, trace);
+        }
+
+        int err = posix_spawnp(&cpid, args[0], &actions, NULL, args, environment);
+        if(err != 0){
+            fprintf(stderr, "%s: %s\n", args[0], strerror(err));
+            cpid = -1;
+        }
+        posix_spawn_file_actions_destroy(&actions);
+        if(trace != NULL){
+            free(environment);
+        }
+    }
+  }
+  releaseInvocation(&inv);
+  return cpid;
+}
+
+/* IO Redirection 
+ * redirects  The redirections found in a parsed line by parseRedirections
+ * count      The number of redirections
+ * actions    The file actions of the child that will run the line
+ * 
+ * The ioRedirection function turns each redirection (>, >>, <) into an 
+ * open() of its file onto standard output or input, added to actions, 
+ * which the child performs before it executes the command. 
+ * 
+ * Does nothing if there is no need to redirect I/O.
+ */
+void ioRedirection(struct Redirect *redirects, int count, posix_spawn_file_actions_t *actions){
+    for(int i = 0; i < count; i++){
+        posix_spawn_file_actions_addopen(actions, redirects[i].fd, redirects[i].file, 
+                redirects[i].flags, 0644);
+    }
+}
+
+/* Find Goals
+ * goalc    The number of goals
+ * goals    The goal names
+ * head     The head of the Target linked list
+ * roots    Filled with the goal targets; room for goalc of them.
+ * 
+ * Looks each goal up in the index, once. Names that match no target 
+ * are skipped, as are repeats (inGraph marks the goals already found 
+ * while the list is built). Returns the number of goal targets.
+ */
+static int findGoals(int goalc, const char* goals[], struct Target *head, struct Target **roots){
+    int count = 0;
+    for(int i = 0; i < goalc; i++){
+        struct Target *goal = findTarget(head, goals[i]);
+        if(goal != NULL && !goal->inGraph){
+            goal->inGraph = 1;
+            roots[count++] = goal;
+        }
+    }
+    for(int i = 0; i < count; i++){
+        roots[i]->inGraph = 0;
+    }
+    return count;
+}
+
+/* Mark Goals
+ * roots    The goal targets.
+ * count    The number of goal targets.
+ * head     The head of the Target linked list
+ * withDone Whether to include targets that are already DONE.
+ * 
+ * Sets inGraph on every target reachable from the goals, walking with 
+ * an explicit stack (a target is pushed once, when it is marked). 
+ * Unless withDone is set, targets already DONE (in an earlier build of
+ * a --watch session) are left out, along with everything behind them.
+ * Returns the number of targets marked; the caller clears the marks.
+ */
+static int markGoals(struct Target **roots, int count, struct Target *head, int withDone){
+    struct Target **stack = malloc((countTargets(head) + 1) * sizeof(struct Target *));
+    int depth = 0;
+    int marked = 0;
+    for(int i = 0; i < count; i++){
+        struct Target *goal = roots[i];
+        if(!goal->inGraph && (withDone || goal->state != DONE)){
+            goal->inGraph = 1;
+            stack[depth++] = goal;
+        }
+    }
+    while(depth > 0){
+        struct Target *target = stack[--depth];
+        marked++;
+        for(int i = 0; i < target->depCount; i++){
+            struct Target *dep = target->depTargets[i];
+            if(dep != NULL && !dep->inGraph && (withDone || dep->state != DONE)){
+                dep->inGraph = 1;
+                stack[depth++] = dep;
+            }
+        }
+    }
+    free(stack);
+    return marked;
+}
+
+/* Print Cycle
+ * path     The targets of a cycle, each depending on the next.
+ * length   The number of targets; the last one depends on the first.
+ * 
+ * Prints the cycle as one error line, closing it with the first target.
+ */
+static void printCycle(struct Target **path, int length){
+    fprintf(stderr, "ERROR: Circular dependency: ");
+    for(int i = 0; i < length; i++){
+        fprintf(stderr, "%s -> ", path[i]->targetName);
+    }
+    fprintf(stderr, "%s\n", path[0]->targetName);
+}
+
+/* Prefetch Goals
+ * roots    The goal targets.
+ * count    The number of goal targets.
+ * head     The head of the Target linked list
+ *
+ * Collects the name of every target markGoals finds and of each of
+ * their plain file dependencies, and hands them to prefetchFiles, so 
+ * the freshness checks of the build find every file already in the 
+ * stat cache.
+ */
+static void prefetchGoals(struct Target **roots, int count, struct Target *head){
+    if(markGoals(roots, count, head, 0) == 0){
+        return;
+    }
+    int pathCap = countTargets(head) + 1;
+    int pathCount = 0;
+    const char **paths = malloc(pathCap * sizeof(char *));
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        if(!current->inGraph){
+            continue;
+        }
+        current->inGraph = 0;
+        if(pathCount + current->depCount + 1 > pathCap){
+            pathCap = 2 * pathCap + current->depCount;
+            paths = realloc(paths, pathCap * sizeof(char *));
+        }
+        paths[pathCount++] = current->targetName;
+        for(int i = 0; i < current->depCount; i++){
+            if(current->depTargets[i] == NULL){
+                paths[pathCount++] = current->depNames[i];
+            }
+        }
+    }
+    prefetchFiles(paths, pathCount);
+    free(paths);
+}
+
+/* Run Goals
+ * goalc    The number of goals requested on the command line
+ * goals    The requested goal names
+ * head     The head of the Target linked list
+ * jobs     The maximum number of rule lines to run at once
+ *
+ * The files the goals depend on are stat()ed up front in one batch.
+ */
+int runGoals(int goalc, const char* goals[], struct Target *head, int jobs){
+    struct Target **roots = malloc((goalc + 1) * sizeof(struct Target *));
+    int count = findGoals(goalc, goals, head, roots);
+    prefetchGoals(roots, count, head);
+    int failed;
+    if(jobs > 1){
+        failed = parallelRules(roots, count, head, jobs);
+    } else {
+        failed = executeRules(roots, count);
+    }
+    free(roots);
+    return failed;
+}
+
+/* Report Failure
+ * target   The target whose rule line failed.
+ * status   The line's wait status, or -1 if it could not be run or 
+ *          failed as a builtin (which has said why already).
+ */
+static void reportFailure(struct Target *target, int status){
+    if(status == -1){
+        fprintf(stderr, "ERROR: Rules for %s failed.\n", target->targetName);
+    } else if(WIFSIGNALED(status)){
+        fprintf(stderr, "ERROR: Rules for %s were killed by signal %d.\n", target->targetName, 
+                WTERMSIG(status));
+    } else {
+        fprintf(stderr, "ERROR: Rules for %s failed with exit status %d.\n", target->targetName, 
+                WEXITSTATUS(status));
+    }
+}
+
+/* Invalidate Outputs
+ * target   A target whose rules have all succeeded.
+ *
+ * Refreshes the cached file information of the target and of every 
+ * file its rule lines name, as an argument or a redirection: those are
+ * the files the rules can be expected to have written, side outputs 
+ * included. Other entries, prefetched ones too, are left alone, so a 
+ * file a command writes without naming it (the .d file of gcc -MD, 
+ * say) is only seen to change on the next run.
+ */
+static void invalidateOutputs(struct Target *target){
+    invalidateFile(target->targetName);
+    for(struct Rules *current = target->ruleList; current != NULL; current = current->next){
+        if(current->command == NULL){
+            continue;
+        }
+        struct Invocation inv;
+        instantiateCommand(current->command, &inv);
+        for(int i = 1; i < inv.argCount; i++){
+            if(strcmp(inv.args[i], target->targetName) != 0){
+                invalidateFile(inv.args[i]);
+            }
+        }
+        for(int i = 0; i < inv.redirectCount; i++){
+            if(strcmp(inv.redirects[i].file, target->targetName) != 0){
+                invalidateFile(inv.redirects[i].file);
+            }
+        }
+        releaseInvocation(&inv);
+    }
+}
+
+/* Run Target Rules
+ * target   The target whose rules should be executed.
+ * 
+ * Runs each compiled rule line, skipping the empty rule at the head 
+ * of the list, until one of them fails. The cached file information
+ * of the target, and of the files its rules name if they all ran, is
+ * refreshed afterwards.
+ */
+int runTargetRules(struct Target *target, const char *trace){
+    struct Rules *current = target->ruleList;
+    int status = 0;
+    while(current != NULL && status == 0){
+        if(current->command != NULL){
+            status = processline(current->command, trace);
+        }
+        current = current->next;
+    }
+    if(status == 0){
+        invalidateOutputs(target);
+    } else {
+        invalidateFile(target->targetName);
+    }
+    if(status != 0){
+        reportFailure(target, status);
+        return -1;
+    }
+    return 0;
+}
+
+/* Output Digest
+ * target   A target whose rules are about to run.
+ * before   The modification time of its file, or -1 if there is none.
+ * 
+ * With --restat, returns the digest of the target's file as it is 
+ * before its rules run, for noteOutput; 0 otherwise.
+ */
+static unsigned long long outputDigest(struct Target *target, long long before){
+    if(!restat || before == -1){
+        return 0;
+    }
+    return fileDigest(target->targetName);
+}
+
+/* Note Output
+ * target   A target whose rules have all succeeded.
+ * before   The modification time of its file before they ran, or -1.
+ * digest   Its digest from then (see outputDigest).
+ * started  The file clock when they started.
+ * 
+ * With --restat, records in the history whether the rules left the 
+ * file as it was. If they did not touch it, the target counts as built
+ * when they started, although its file is older. If they wrote the 
+ * same bytes again, its contents still count as changed when they did
+ * before. Either way checkTime sees nothing new for the targets that 
+ * depend on it, which cuts a rebuild off there. A file that did change
+ * drops the times recorded for it.
+ */
+static void noteOutput(struct Target *target, long long before, unsigned long long digest, 
+        long long started){
+    struct FileInfo *info = statFile(target->targetName);
+    if(!restat || before == -1 || !info->exists){
+        return;
+    }
+    if(info->mtime == before){
+        recordTimes(target->targetName, before, started, changedTime(target->targetName, before));
+    } else if(fileDigest(target->targetName) == digest){
+        recordTimes(target->targetName, info->mtime, info->mtime, 
+                changedTime(target->targetName, before));
+    } else {
+        recordTimes(target->targetName, info->mtime, info->mtime, info->mtime);
+    }
+}
+
+/* Frame Structure
+ * 
+ * One target on executeRules' stack: the index of its next dependency
+ * to look at and the number of its dependencies that failed so far.
+ */
+struct Frame {
+    struct Target *target;
+    int next;
+    int failed;
+};
+
+/* Report Frames Cycle
+ * stack    executeRules' stack.
+ * depth    The number of frames on it.
+ * repeat   The IN_PROGRESS target the top frame depends on.
+ * 
+ * The IN_PROGRESS targets are exactly the ones on the stack, so the 
+ * cycle runs from repeat's frame to the top.
+ */
+static void reportFramesCycle(struct Frame *stack, int depth, struct Target *repeat){
+    int first = depth - 1;
+    while(stack[first].target != repeat){
+        first--;
+    }
+    struct Target **path = malloc((depth - first) * sizeof(struct Target *));
+    for(int i = first; i < depth; i++){
+        path[i - first] = stack[i].target;
+    }
+    printCycle(path, depth - first);
+    free(path);
+}
+
+/* Execute Rules
+ * roots    The goal targets, each listed once.
+ * count    The number of goal targets.
+ * 
+ * Goals are pushed one at a time, each once the walk of the ones 
+ * before it has finished; a goal some earlier goal already reached 
+ * just keeps its remembered result. A pushed target is marked 
+ * IN_PROGRESS, and its dependencies are pushed one at a time as the 
+ * frame on top reaches them. Meeting a dependency that is still 
+ * IN_PROGRESS means the graph has a cycle; it is reported and counted
+ * as a failed dependency, so the walk always ends. Once a frame has 
+ * no dependencies left it is popped: with a failed dependency the 
+ * target is FAILED, otherwise needsRebuild is called once and the 
+ * result kept in target->stale before the rules are run. How long the 
+ * rules take is recorded in the history, for parallelRules to use, 
+ * along with (with --restat) whether they changed the target's file.
+ * With --trace-deps they run traced, and the files they read are 
+ * recorded for checkTime.
+ * 
+ * A target whose rules fail is FAILED, which fails the targets above 
+ * it on the stack in turn. Without -k the walk ends right there: every
+ * target still on the stack is FAILED and no further goal is started.
+ */
+int executeRules(struct Target **roots, int count){
+    int cap = STACK_START;
+    int depth = 0;
+    struct Frame *stack = malloc(cap * sizeof(struct Frame));
+    int failedGoals = 0;
+    int stopped = 0;
+
+    for(int goal = 0; goal < count && !stopped; goal++){
+        if(roots[goal]->state == UNVISITED){
+            roots[goal]->state = IN_PROGRESS;
+            stack[depth++] = (struct Frame){roots[goal], 0, 0};
+        }
+        while(depth > 0){
+            struct Frame *frame = &stack[depth-1];
+            struct Target *current = frame->target;
+            if(frame->next < current->depCount){
+                struct Target *dep = current->depTargets[frame->next++];
+                if(dep == NULL || dep->state == DONE){
+                    continue;
+                } else if(dep->state == IN_PROGRESS){
+                    reportFramesCycle(stack, depth, dep);
+                    frame->failed++;
+                } else if(dep->state == FAILED){
+                    frame->failed++;
+                } else {
+                    if(depth == cap){
+                        cap *= 2;
+                        stack = realloc(stack, cap * sizeof(struct Frame));
+                    }
+                    dep->state = IN_PROGRESS;
+                    stack[depth++] = (struct Frame){dep, 0, 0};
+                }
+                continue;
+            }
+
+            depth--;
+            if(frame->failed != 0){
+                current->state = FAILED;
+                if(depth > 0){
+                    stack[depth-1].failed++;
+                }
+                continue;
+            }
+            current->stale = needsRebuild(current);
+            if(current->stale == 1 && !restoreTarget(current)){
+                double started = now();
+                struct FileInfo *info = statFile(current->targetName);
+                long long before = info->exists ? info->mtime : -1;
+                unsigned long long digest = outputDigest(current, before);
+                long long clock = fileClock();
+                char *trace = traceDeps ? openTraceLog() : NULL;
+                if(runTargetRules(current, trace) != 0){
+                    discardTrace(trace);
+                    current->state = FAILED;
+                    if(depth > 0){
+                        stack[depth-1].failed++;
+                    }
+                    if(!keepGoing){
+                        while(depth > 0){
+                            stack[--depth].target->state = FAILED;
+                        }
+                        stopped = 1;
+                    }
+                    continue;
+                }
+                recordDuration(current->targetName, (long long)((now() - started) * 1e9));
+                noteOutput(current, before, digest, clock);
+                if(trace != NULL){
+                    collectTrace(current, trace);
+                }
+                storeTarget(current);
+            }
+            if(useDigests){
+                dbRecordTarget(current, current->rulesDigest);
+            }
+            current->state = DONE;
+        }
+    }
+    for(int goal = 0; goal < count; goal++){
+        if(roots[goal]->state != DONE){
+            failedGoals++;
+        }
+    }
+    free(stack);
+    return failedGoals;
+}
+
+/* Restore Target
+ * target   A target whose rules need to run.
+ * 
+ * The key is worked out once here and kept on the target for 
+ * storeTarget. The restored file is re-stat()ed into the stat cache.
+ */
+int restoreTarget(struct Target *target){
+    if(cacheDir == NULL){
+        return 0;
+    }
+    if(!useDigests){
+        target->rulesDigest = rulesDigest(target);
+    }
+    target->artifactKey = artifactKey(target, target->rulesDigest);
+    if(!restoreArtifact(cacheDir, target->artifactKey, target->targetName)){
+        return 0;
+    }
+    invalidateFile(target->targetName);
+    return 1;
+}
+
+/* Store Target
+ * target   A target whose rules have just run.
+ * 
+ * Targets whose rules made no file (such as clean) store nothing. 
+ * With --trace-deps the key is worked out again, as the rules have 
+ * just been traced and may have read files they did not read before.
+ */
+void storeTarget(struct Target *target){
+    if(cacheDir == NULL || !statFile(target->targetName)->exists){
+        return;
+    }
+    if(traceDeps){
+        target->artifactKey = artifactKey(target, target->rulesDigest);
+    }
+    storeArtifact(cacheDir, target->artifactKey, target->targetName);
+}
+
+/* Needs Rebuild
+ * target   A target whose dependencies are up to date.
+ * 
+ * With --digests, the expanded rules are digested (and remembered on 
+ * the target for recording later) and the database decides; a 
+ * target it has no record of uses the time comparison.
+ */
+int needsRebuild(struct Target *target){
+    int stale = checkTime(target->targetName, target);
+    if(!useDigests){
+        return stale;
+    }
+    target->rulesDigest = rulesDigest(target);
+    int changed = dbTargetChanged(target, target->rulesDigest);
+    if(changed == -1){
+        return stale;
+    }
+    return changed;
+}
+
+/* Rules Digest
+ * target   The target whose rules should be digested.
+ * 
+ * Chains the digests of each rule line, expanded the same way 
+ * startLine expands it, so changing a variable a rule uses changes 
+ * the digest.
+ */
+unsigned long long rulesDigest(struct Target *target){
+    unsigned long long digest = 0;
+    struct Rules *current = target->ruleList;
+    while(current != NULL){
+        if(current->rulesList != NULL){
+            char *new = expand(current->rulesList);
+            digest = digestBytes(new, strlen(new)+1, digest);
+            free(new);
+        }
+        current = current->next;
+    }
+    return digest;
+}
+
+/* Job Structure
+ * 
+ * One slot of the parallel scheduler: the target whose rules are 
+ * running, the child currently executing one of its rule lines, the 
+ * rule line to start once that child exits and when the target's first
+ * rule line started. A pid of 0 marks a free slot. pidfd watches the 
+ * child for waitChild (-1 if it is not watched), and when captured is 
+ * set the target's output goes through output. killed is set once the
+ * child has been killed because another target failed, and before is 
+ * the target file's modification time when the job started (-1 if 
+ * there was no file); digest and clock are what noteOutput needs. 
+ * trace is the log the target's rules are traced into, or NULL.
+ */
+struct Job {
+    struct Target *target;
+    struct Rules *nextRule;
+    pid_t pid;
+    double started;
+    int killed;
+    long long before;
+    unsigned long long digest;
+    long long clock;
+    char *trace;
+    int pidfd;
+    int captured;
+    struct JobOutput output;
+};
+
+/* Start Next Rule
+ * job      A scheduler slot with a target assigned.
+ * events   The scheduler's epoll instance, or -1.
+ * 
+ * Starts the next non-empty rule line of the job's target and adds a 
+ * pidfd for its child to events. Returns the pid of the child, 0 once 
+ * the target has no rules left, or -1 if a line could not be started 
+ * or failed as a builtin. In the last two cases the job's captured 
+ * output is written out in one piece.
+ */
+static pid_t startNextRule(struct Job *job, int events){
+    if(job->pidfd != -1){
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+    pid_t pid = 0;
+    while(job->nextRule != NULL && pid == 0){
+        struct Rules *current = job->nextRule;
+        job->nextRule = current->next;
+        if(current->command != NULL){
+            pid = startLine(current->command, job->captured ? &job->output : NULL, job->trace);
+        }
+    }
+    if(pid > 0){
+        if(events != -1){
+            job->pidfd = syscall(SYS_pidfd_open, pid, 0);
+            struct epoll_event event = {EPOLLIN, {.fd = job->pidfd}};
+            if(job->pidfd != -1 && epoll_ctl(events, EPOLL_CTL_ADD, job->pidfd, &event) == -1){
+                close(job->pidfd);
+                job->pidfd = -1;
+            }
+        }
+        return pid;
+    }
+    if(job->captured){
+        closeJobOutput(&job->output, events);
+        job->captured = 0;
+    }
+    return pid;
+}
+
+/* Stop Job
+ * job      A slot whose child has just been reaped.
+ * events   The scheduler's epoll instance, or -1.
+ * 
+ * Drops the rest of the job's rule lines and writes out its captured 
+ * output, freeing the slot.
+ */
+static void stopJob(struct Job *job, int events){
+    job->nextRule = NULL;
+    job->pid = startNextRule(job, events);
+}
+
+/* Kill Jobs
+ * slots    The scheduler slots.
+ * jobs     The number of slots.
+ * 
+ * Sends SIGTERM to every running child, for a build that stops at its
+ * first failure. The children are still reaped as usual.
+ */
+static void killJobs(struct Job *slots, int jobs){
+    for(int i = 0; i < jobs; i++){
+        if(slots[i].pid > 0 && !slots[i].killed){
+            kill(slots[i].pid, SIGTERM);
+            slots[i].killed = 1;
+        }
+    }
+}
+
+/* Remove Partial
+ * job      A slot whose child was killed.
+ * 
+ * A rule killed half way may leave its target file written in part, 
+ * and newer than its dependencies, so the next build would take it 
+ * for up to date. Like make, umake deletes the file if the job changed
+ * it.
+ */
+static void removePartial(struct Job *job){
+    const char *name = job->target->targetName;
+    invalidateFile(name);
+    struct FileInfo *info = statFile(name);
+    if(info->exists && info->mtime != job->before && unlink(name) == 0){
+        fprintf(stderr, "ERROR: Deleting %s, its rules were interrupted.\n", name);
+        invalidateFile(name);
+    }
+}
+
+/* Fail Target
+ * target   A target of the parallel build whose rules failed.
+ * 
+ * Marks target FAILED, and with it every target downstream of it in 
+ * the build: none of them can be built any more. Returns the number of
+ * targets marked.
+ */
+static int failTarget(struct Target *target){
+    int cap = STACK_START;
+    int depth = 0;
+    int marked = 1;
+    struct Target **stack = malloc(cap * sizeof(struct Target *));
+    target->state = FAILED;
+    stack[depth++] = target;
+    while(depth > 0){
+        struct Target *current = stack[--depth];
+        for(int i = 0; i < current->dependentCount; i++){
+            struct Target *dependent = current->dependents[i];
+            if(!dependent->inGraph || dependent->state == FAILED){
+                continue;
+            }
+            if(depth == cap){
+                cap *= 2;
+                stack = realloc(stack, cap * sizeof(struct Target *));
+            }
+            dependent->state = FAILED;
+            stack[depth++] = dependent;
+            marked++;
+        }
+    }
+    free(stack);
+    return marked;
+}
+
+/* Ready Structure
+ * 
+ * One entry of the parallel scheduler's ready queue: a target with no
+ * unfinished dependencies and the order in which it became ready.
+ */
+struct Ready {
+    struct Target *target;
+    int order;
+};
+
+/* Ready Queue Structure
+ * 
+ * A binary heap of ready targets, ordered by ranksBefore. added counts
+ * every target ever pushed and gives each one its order.
+ */
+struct ReadyQueue {
+    struct Ready *heap;
+    int count;
+    int added;
+};
+
+/* Ranks Before
+ * a        A ready target.
+ * b        Another ready target.
+ * 
+ * Returns 1 if a should start before b: it has the higher priority, or
+ * the same priority and became ready first. With no durations recorded
+ * every priority is 0 and targets start in the order they got ready.
+ */
+static int ranksBefore(struct Ready *a, struct Ready *b){
+    return a->target->priority > b->target->priority 
+        || (a->target->priority == b->target->priority && a->order < b->order);
+}
+
+/* Push Ready
+ * queue    The ready queue.
+ * target   A target with no unfinished dependencies.
+ */
+static void pushReady(struct ReadyQueue *queue, struct Target *target){
+    struct Ready entry = {target, queue->added++};
+    int i = queue->count++;
+    while(i > 0 && ranksBefore(&entry, &queue->heap[(i-1)/2])){
+        queue->heap[i] = queue->heap[(i-1)/2];
+        i = (i-1)/2;
+    }
+    queue->heap[i] = entry;
+}
+
+/* Pop Ready
+ * queue    The ready queue, holding at least one target.
+ * 
+ * Removes and returns the target that should start first.
+ */
+static struct Target *popReady(struct ReadyQueue *queue){
+    struct Target *top = queue->heap[0].target;
+    struct Ready last = queue->heap[--queue->count];
+    int i = 0;
+    while(2*i+1 < queue->count){
+        int child = 2*i+1;
+        if(child+1 < queue->count && ranksBefore(&queue->heap[child+1], &queue->heap[child])){
+            child++;
+        }
+        if(!ranksBefore(&queue->heap[child], &last)){
+            break;
+        }
+        queue->heap[i] = queue->heap[child];
+        i = child;
+    }
+    queue->heap[i] = last;
+    return top;
+}
+
+/* Set Priorities
+ * head     The head of the Target linked list, with the goals' 
+ *          subgraph marked.
+ * 
+ * A target's priority is the longest chain of expected rule durations
+ * from it up to a goal: its own duration plus the largest priority 
+ * among the targets in the graph depending on it. Durations come from
+ * the history; a target never timed is expected to take the average 
+ * recorded duration.
+ * 
+ * Priorities are settled from the goals down: pending first counts 
+ * each target's dependents in the graph, and a target is settled once
+ * all of them are. Targets on a cycle are never settled and keep 
+ * priority 0. pending is left at 0.
+ */
+static void setPriorities(struct Target *head){
+    long long estimate = averageDuration();
+    int total = 0;
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        current->priority = 0;
+        if(current->inGraph){
+            total++;
+            for(int i = 0; i < current->dependentCount; i++){
+                if(current->dependents[i]->inGraph){
+                    current->pending++;
+                }
+            }
+        }
+    }
+
+    struct Target **settled = malloc((total+1)*sizeof(struct Target *));
+    int settledHead = 0;
+    int settledTail = 0;
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        if(current->inGraph && current->pending == 0){
+            settled[settledTail++] = current;
+        }
+    }
+    while(settledHead < settledTail){
+        struct Target *target = settled[settledHead++];
+        long long duration = targetDuration(target->targetName);
+        target->priority += duration >= 0 ? duration : estimate;
+        for(int i = 0; i < target->depCount; i++){
+            struct Target *dep = target->depTargets[i];
+            if(dep == NULL || !dep->inGraph){
+                continue;
+            }
+            if(target->priority > dep->priority){
+                dep->priority = target->priority;
+            }
+            if(--dep->pending == 0){
+                settled[settledTail++] = dep;
+            }
+        }
+    }
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        current->pending = 0;
+    }
+    free(settled);
+}
+
+/* Finish Target
+ * target   A target whose rules have all completed (or were up to date).
+ * queue    The ready queue.
+ * 
+ * Marks target DONE and releases its dependents, queueing every one of 
+ * them that has no unfinished dependencies left. The caller has already
+ * refreshed the cached file information of whatever its rules wrote.
+ */
+static void finishTarget(struct Target *target, struct ReadyQueue *queue){
+    target->state = DONE;
+    if(useDigests){
+        dbRecordTarget(target, target->rulesDigest);
+    }
+    for(int i = 0; i < target->dependentCount; i++){
+        struct Target *dependent = target->dependents[i];
+        if(dependent->inGraph && --dependent->pending == 0 && dependent->state != FAILED){
+            pushReady(queue, dependent);
+        }
+    }
+}
+
+/* Report Pending Cycle
+ * head     The head of the Target linked list, after parallelRules 
+ *          ran out of targets to start.
+ * 
+ * Every target left pending waits on a dependency in the graph that is 
+ * not DONE, so following such dependencies from any of them has to 
+ * come back to a target already on the path; the path from there on 
+ * is a cycle. Targets on the path are marked with inGraph set to 2.
+ */
+static void reportPendingCycle(struct Target *head){
+    struct Target *current = head->next;
+    while(current != NULL && !(current->inGraph && current->state == UNVISITED)){
+        current = current->next;
+    }
+    if(current == NULL){
+        return;
+    }
+    int cap = STACK_START;
+    int length = 0;
+    struct Target **path = malloc(cap * sizeof(struct Target *));
+    while(current != NULL && current->inGraph != 2){
+        if(length == cap){
+            cap *= 2;
+            path = realloc(path, cap * sizeof(struct Target *));
+        }
+        current->inGraph = 2;
+        path[length++] = current;
+        struct Target *next = NULL;
+        for(int i = 0; i < current->depCount && next == NULL; i++){
+            struct Target *dep = current->depTargets[i];
+            if(dep != NULL && dep->inGraph && dep->state == UNVISITED){
+                next = dep;
+            }
+        }
+        current = next;
+    }
+    if(current != NULL){
+        int first = length - 1;
+        while(path[first] != current){
+            first--;
+        }
+        printCycle(&path[first], length - first);
+    }
+    free(path);
+}
+
+/* Capacity Structure
+ * 
+ * What the running targets of a parallel build take up: the job slots
+ * and the memory (in kilobytes) their .RESOURCES declared. load and 
+ * available are the system's load (plus the slots started since) and 
+ * free memory as read in this round of the scheduler; both are -1 
+ * until read (or if they cannot be).
+ */
+struct Capacity {
+    int used;
+    long long reserved;
+    double load;
+    long long available;
+};
+
+/* Slot Weight
+ * target   A target.
+ * jobs     The job limit.
+ * 
+ * Returns the job slots target takes. A target declaring more slots 
+ * than there are takes all of them.
+ */
+static int slotWeight(struct Target *target, int jobs){
+    return target->jobWeight < jobs ? target->jobWeight : jobs;
+}
+
+/* Within Limits
+ * target   A ready target whose rules have to run.
+ * capacity What the running targets take up.
+ * 
+ * Returns 1 if the load is below --max-load, and the memory target 
+ * declares fits both within --max-mem and within the memory free right
+ * now, next to what the running targets declared. A target that has 
+ * just started has not allocated its memory yet, so the free memory 
+ * has to cover all of theirs; one that has is counted twice, which 
+ * only errs on the safe side. The load and free memory are only read 
+ * when a limit needs them, once a round.
+ */
+static int withinLimits(struct Target *target, struct Capacity *capacity){
+    if(maxLoad > 0){
+        if(capacity->load < 0){
+            capacity->load = systemLoad();
+        }
+        if(capacity->load >= maxLoad){
+            return 0;
+        }
+    }
+    if(target->memWeight > 0){
+        if(maxMemory > 0 && capacity->reserved + target->memWeight > maxMemory){
+            return 0;
+        }
+        if(capacity->available < 0){
+            capacity->available = availableMemory();
+        }
+        if(capacity->available >= 0 && capacity->reserved + target->memWeight > capacity->available){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Claim Capacity
+ * target   A target about to start.
+ * capacity What the running targets take up.
+ * weight   The slots target takes.
+ * 
+ * Adds target to the running targets' share, and counts it against 
+ * the load read this round, which does not show it yet.
+ */
+static void claimCapacity(struct Target *target, struct Capacity *capacity, int weight){
+    capacity->used += weight;
+    capacity->reserved += target->memWeight;
+    if(capacity->load >= 0){
+        capacity->load += weight;
+    }
+}
+
+/* Wait Child
+ * slots    The scheduler slots.
+ * jobs     The number of slots.
+ * status   Set to the exit status of the child reaped.
+ * token    Whether the scheduler is also waiting for a jobserver token.
+ * recheck  Whether the scheduler is also waiting for the load or free
+ *          memory to allow another job.
+ * events   The scheduler's epoll instance, or -1.
+ * 
+ * Blocks until a child exits and reaps it, returning its pid (or -1 
+ * on error). With an epoll instance, umake sleeps in epoll_wait on the
+ * running children's pidfds, the pipes of captured jobs (which are 
+ * drained as they fill, so no child ever blocks writing its output) 
+ * and, when a token is wanted, the jobserver; 0 is returned if a token
+ * may have come free before a child exited, or, with recheck, once 
+ * LIMIT_RECHECK milliseconds have passed without either. A child 
+ * without a pidfd is checked for every WAIT_FALLBACK milliseconds. 
+ * Without an epoll instance only children are waited for.
+ */
+static pid_t waitChild(struct Job *slots, int jobs, int *status, int token, int recheck, int events){
+    if(events == -1){
+        return waitpid(-1, status, 0);
+    }
+    struct epoll_event server = {EPOLLIN, {.fd = jobserverDescriptor()}};
+    if(token && epoll_ctl(events, EPOLL_CTL_ADD, server.data.fd, &server) == -1){
+        token = 0;
+    }
+
+    pid_t pid;
+    int woken = 0;
+    double deadline = now() + LIMIT_RECHECK / 1000.0;
+    while((pid = waitpid(-1, status, WNOHANG)) == 0 && !woken){
+        int timeout = -1;
+        if(recheck){
+            timeout = (int)((deadline - now()) * 1000) + 1;
+            if(timeout <= 0){
+                break;
+            }
+        }
+        for(int i = 0; i < jobs; i++){
+            if(slots[i].pid > 0 && slots[i].pidfd == -1 && (timeout == -1 || timeout > WAIT_FALLBACK)){
+                timeout = WAIT_FALLBACK;
+            }
+        }
+        struct epoll_event ready[EVENT_BATCH];
+        int count = epoll_wait(events, ready, EVENT_BATCH, timeout);
+        if(count == -1 && errno != EINTR){
+            pid = waitpid(-1, status, 0);
+            break;
+        }
+        for(int i = 0; i < count; i++){
+            int fd = ready[i].data.fd;
+            if(token && fd == server.data.fd){
+                woken = 1;
+                continue;
+            }
+            for(int j = 0; j < jobs; j++){
+                if(slots[j].captured && ownsDescriptor(&slots[j].output, fd)){
+                    drainOutput(&slots[j].output, fd);
+                }
+            }
+        }
+    }
+
+    if(token){
+        epoll_ctl(events, EPOLL_CTL_DEL, server.data.fd, NULL);
+    }
+    return pid;
+}
+
+/* Parallel Rules
+ * roots    The goal targets, each listed once.
+ * count    The number of goal targets.
+ * head     The head of the Target linked list
+ * jobs     The maximum number of rule lines to run at once
+ * 
+ * Each target in the goals' subgraph starts with a pending count equal 
+ * to its number of dependency targets. Targets at zero are ready; the 
+ * ready queue is a heap that hands out the target with the highest 
+ * priority (see setPriorities) first, so the long poles of the build 
+ * start as early as they can. When a ready target is started, 
+ * needsRebuild decides whether its rules need to run, and how long 
+ * they take (and, with --restat, whether they changed the target's 
+ * file) is recorded in the history. Finished children are reaped 
+ * with waitChild, the target's next rule line is started in the same 
+ * slot, and once a target has no rule lines left its dependents are 
+ * released.
+ * 
+ * With a jobserver, every running target beyond the first also holds 
+ * one of its tokens. A token is taken before a target is popped and 
+ * kept for the next one if the target turns out to need no slot; 
+ * tokens beyond what the running targets need go back to the pool 
+ * before umake waits, and all of them once the build is over.
+ * 
+ * A target that has to run but does not fit yet is held until it does:
+ * until enough of the job slots come free for its weight, or, if only 
+ * the load or memory is short, for LIMIT_RECHECK milliseconds at a 
+ * time. Nothing else starts ahead of it, so a heavy target on the 
+ * critical path is not starved by light ones, and when nothing is 
+ * running it starts whatever the limits say. With a jobserver, a held 
+ * target keeps the tokens it has gathered for its weight.
+ * 
+ * With --output-sync, each target's rule lines write into pipes of its
+ * own, read through the same epoll instance waitChild sleeps in, and 
+ * what they wrote reaches umake's stdout and stderr whole when the 
+ * target finishes (or line by line, each line marked with the target).
+ * 
+ * A target whose rule line fails (exits non-zero, is killed, or fails
+ * as a builtin) runs no further lines and is FAILED, along with 
+ * everything downstream of it (see failTarget), so none of that is 
+ * ever started. Without -k nothing new starts at all after a failure: 
+ * the children still running are sent SIGTERM (see killJobs), reaped,
+ * and their half-written files removed (see removePartial).
+ * 
+ * Targets still pending when nothing is running (and no failure 
+ * stopped the build) are part of a cycle, or depend on one; 
+ * reportPendingCycle prints it.
+ */
+int parallelRules(struct Target **roots, int count, struct Target *head, int jobs){
+    int total = markGoals(roots, count, head, 0);
+    setPriorities(head);
+    int limited = maxLoad > 0;
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        if(current->inGraph){
+            limited = limited || current->memWeight > 0;
+            for(int i = 0; i < current->depCount; i++){
+                if(current->depTargets[i] != NULL && current->depTargets[i]->inGraph){
+                    current->pending++;
+                }
+            }
+        }
+    }
+
+    struct ReadyQueue queue = {malloc((total+1)*sizeof(struct Ready)), 0, 0};
+    struct Job *slots = calloc(jobs, sizeof(struct Job));
+    for(int i = 0; i < jobs; i++){
+        slots[i].pidfd = -1;
+    }
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        if(current->inGraph && current->pending == 0){
+            pushReady(&queue, current);
+        }
+    }
+
+    int pooled = jobserverDescriptor() != -1;
+    int events = -1;
+    if(pooled || outputMode != OUTPUT_NONE || limited){
+        events = epoll_create1(EPOLL_CLOEXEC);
+    }
+    struct Capacity capacity = {0, 0, -1, -1};
+    struct Target *held = NULL;
+    int running = 0;
+    int finished = 0;
+    int failed = 0;
+    int stopping = 0;
+    while(1){
+        int wantToken = 0;
+        int recheck = 0;
+        capacity.load = -1;
+        capacity.available = -1;
+        while(!stopping && running < jobs && (held != NULL || queue.count > 0)){
+            struct Target *target = held;
+            if(target == NULL){
+                if(pooled && capacity.used > heldTokens() && !acquireToken()){
+                    wantToken = 1;
+                    break;
+                }
+                target = popReady(&queue);
+                target->stale = needsRebuild(target);
+                if(target->stale != 1 || restoreTarget(target)){
+                    finished++;
+                    finishTarget(target, &queue);
+                    continue;
+                }
+            }
+
+            held = target;
+            int weight = slotWeight(target, jobs);
+            if(running > 0 && capacity.used + weight > jobs){
+                break;
+            }
+            while(pooled && running > 0 && capacity.used + weight > heldTokens() + 1 && !wantToken){
+                wantToken = !acquireToken();
+            }
+            if(wantToken){
+                break;
+            }
+            if(running > 0 && !withinLimits(target, &capacity)){
+                recheck = 1;
+                break;
+            }
+            held = NULL;
+
+            struct Job *slot = slots;
+            while(slot->pid != 0){
+                slot++;
+            }
+            struct FileInfo *info = statFile(target->targetName);
+            slot->target = target;
+            slot->nextRule = target->ruleList;
+            slot->started = now();
+            slot->killed = 0;
+            slot->before = info->exists ? info->mtime : -1;
+            slot->digest = outputDigest(target, slot->before);
+            slot->clock = fileClock();
+            slot->trace = traceDeps ? openTraceLog() : NULL;
+            slot->captured = outputMode != OUTPUT_NONE && events != -1
+                && openJobOutput(&slot->output, target->targetName, outputMode, events);
+            slot->pid = startNextRule(slot, events);
+            if(slot->pid > 0){
+                claimCapacity(target, &capacity, weight);
+                running++;
+                continue;
+            } else if(slot->pid == -1){
+                slot->pid = 0;
+                invalidateFile(target->targetName);
+                discardTrace(slot->trace);
+                reportFailure(target, -1);
+                failed += failTarget(target);
+                if(!keepGoing){
+                    stopping = 1;
+                    killJobs(slots, jobs);
+                }
+                continue;
+            }
+            recordDuration(target->targetName, (long long)((now() - slot->started) * 1e9));
+            invalidateOutputs(target);
+            noteOutput(target, slot->before, slot->digest, slot->clock);
+            if(slot->trace != NULL){
+                collectTrace(target, slot->trace);
+            }
+            storeTarget(target);
+            finished++;
+            finishTarget(target, &queue);
+        }
+        if(running == 0){
+            break;
+        }
+        int keep = capacity.used - 1;
+        if(held != NULL && !stopping){
+            keep += slotWeight(held, jobs);
+        }
+        while(heldTokens() > keep){
+            releaseToken();
+        }
+
+        int status;
+        const pid_t pid = waitChild(slots, jobs, &status, wantToken, recheck, events);
+        if(pid == 0){
+            continue;
+        } else if(pid == -1){
+            perror("waitpid");
+            break;
+        }
+        struct Job *slot = NULL;
+        for(int i = 0; i < jobs; i++){
+            if(slots[i].pid == pid){
+                slot = &slots[i];
+            }
+        }
+        if(slot == NULL){
+            continue;
+        }
+        struct Target *target = slot->target;
+        int lineStatus = status;
+        if(slot->killed){
+            stopJob(slot, events);
+            removePartial(slot);
+        } else if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            stopJob(slot, events);
+        } else {
+            slot->pid = startNextRule(slot, events);
+            lineStatus = slot->pid == -1 ? -1 : 0;
+            if(slot->pid > 0){
+                continue;
+            }
+            slot->pid = 0;
+        }
+        running--;
+        capacity.used -= slotWeight(target, jobs);
+        capacity.reserved -= target->memWeight;
+        if(slot->killed || lineStatus != 0){
+            invalidateFile(target->targetName);
+            discardTrace(slot->trace);
+            if(!slot->killed){
+                reportFailure(target, lineStatus);
+            }
+            failed += failTarget(target);
+            if(!keepGoing && !stopping){
+                stopping = 1;
+                killJobs(slots, jobs);
+            }
+        } else {
+            finished++;
+            recordDuration(slot->target->targetName, (long long)((now() - slot->started) * 1e9));
+            invalidateOutputs(slot->target);
+            noteOutput(slot->target, slot->before, slot->digest, slot->clock);
+            if(slot->trace != NULL){
+                collectTrace(slot->target, slot->trace);
+            }
+            storeTarget(slot->target);
+            finishTarget(slot->target, &queue);
+        }
+    }
+
+    while(heldTokens() > 0){
+        releaseToken();
+    }
+    if(finished < total){
+        if(!stopping && finished + failed < total){
+            reportPendingCycle(head);
+        }
+        fprintf(stderr, "ERROR: %d target(s) could not be built.\n", total - finished);
+        for(struct Target *current = head->next; current != NULL; current = current->next){
+            if(current->inGraph && current->state != DONE){
+                current->state = FAILED;
+            }
+        }
+    }
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        current->inGraph = 0;
+        current->pending = 0;
+    }
+    if(events != -1){
+        close(events);
+    }
+    free(queue.heap);
+    free(slots);
+
+    int failedGoals = 0;
+    for(int i = 0; i < count; i++){
+        if(roots[i]->state != DONE){
+            failedGoals++;
+        }
+    }
+    return failedGoals;
+}
+
+/* Watch Goals
+ * watch    An open watch.
+ * goalc    The number of goals
+ * goals    The goal names
+ * head     The head of the Target linked list
+ * 
+ * Watches the uMakefile and everything the goals depend on: each 
+ * target markGoals finds and each of its plain file dependencies. 
+ * Each file is stat()ed into the cache, so that watchRules can later 
+ * tell a real change from one umake made itself.
+ */
+static void watchGoals(struct Watch *watch, int goalc, const char* goals[], struct Target *head){
+    watchPath(watch, MAKEFILE);
+    statFile(MAKEFILE);
+    struct Target **roots = malloc((goalc + 1) * sizeof(struct Target *));
+    markGoals(roots, findGoals(goalc, goals, head, roots), head, 1);
+    free(roots);
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        if(!current->inGraph){
+            continue;
+        }
+        current->inGraph = 0;
+        watchPath(watch, current->targetName);
+        statFile(current->targetName);
+        for(int i = 0; i < current->depCount; i++){
+            if(current->depTargets[i] == NULL){
+                watchPath(watch, current->depNames[i]);
+                statFile(current->depNames[i]);
+            }
+        }
+    }
+}
+
+/* File Changed
+ * path     A path inotify reported.
+ * 
+ * Compares what the stat cache knows about path with a fresh stat(). 
+ * Returns 1 if the file really changed: events for files whose new
+ * state umake already recorded (its own outputs) are ignored. A path
+ * not in the cache counts as changed.
+ */
+static int fileChanged(const char *path){
+    struct FileInfo *info = cachedFile(path);
+    if(info == NULL){
+        statFile(path);
+        return 1;
+    }
+    struct FileInfo before = *info;
+    invalidateFile(path);
+    return info->exists != before.exists || info->mtime != before.mtime 
+        || info->size != before.size || info->inode != before.inode;
+}
+
+/* Reset Downstream
+ * target   A target whose inputs changed.
+ * 
+ * Marks target and every target that depends on it, directly or not,
+ * UNVISITED, so the next build evaluates them again. A target is reset
+ * as it is pushed, so none is pushed twice. Returns the number of 
+ * targets reset.
+ */
+static int resetDownstream(struct Target *target){
+    if(target->state == UNVISITED){
+        return 0;
+    }
+    int cap = STACK_START;
+    int depth = 0;
+    struct Target **stack = malloc(cap * sizeof(struct Target *));
+    target->state = UNVISITED;
+    target->stale = 0;
+    stack[depth++] = target;
+    int count = 1;
+    while(depth > 0){
+        struct Target *current = stack[--depth];
+        for(int i = 0; i < current->dependentCount; i++){
+            struct Target *dependent = current->dependents[i];
+            if(dependent->state == UNVISITED){
+                continue;
+            }
+            if(depth == cap){
+                cap *= 2;
+                stack = realloc(stack, cap * sizeof(struct Target *));
+            }
+            dependent->state = UNVISITED;
+            dependent->stale = 0;
+            stack[depth++] = dependent;
+            count++;
+        }
+    }
+    free(stack);
+    return count;
+}
+
+/* Reset Changed
+ * head     The head of the Target linked list
+ * path     A changed file, or NULL to look at every file in the graph.
+ * 
+ * Resets (with resetDownstream) the target named path and the targets
+ * that have path as a plain file dependency. With a NULL path, each
+ * target and file dependency is checked with fileChanged instead. 
+ * Returns the number of targets reset.
+ */
+static int resetChanged(struct Target *head, const char *path){
+    int count = 0;
+    for(struct Target *current = head->next; current != NULL; current = current->next){
+        if(path == NULL ? fileChanged(current->targetName) 
+                : strcmp(watchName(current->targetName), path) == 0){
+            count += resetDownstream(current);
+            continue;
+        }
+        for(int i = 0; i < current->depCount; i++){
+            if(current->depTargets[i] == NULL && (path == NULL ? fileChanged(current->depNames[i]) 
+                    : strcmp(watchName(current->depNames[i]), path) == 0)){
+                count += resetDownstream(current);
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/* Watch Rules
+ * goalc    The number of goals requested on the command line
+ * goals    The requested goal names
+ * head     The head of the Target linked list, already built once
+ * jobs     The maximum number of rule lines to run at once
+ * 
+ * Each batch of changes from waitForChanges is filtered through 
+ * fileChanged. A changed file resets the targets named after it or 
+ * depending on it (and everything downstream of them); targets that 
+ * failed are always tried again. The goals are then run as usual, and
+ * since every other target is still DONE only the reset ones are 
+ * looked at. If the kernel dropped events, the stat cache is cleared 
+ * and the whole graph is checked. So is every file of the graph when 
+ * a directory that was missing can finally be watched, since files 
+ * may have appeared in it before the watch was in place.
+ * 
+ * A changed uMakefile frees the whole graph and loads it again, then 
+ * builds the goals from scratch (the stat cache is kept). If inotify 
+ * cannot be read any more, watching stops.
+ */
+struct Target *watchRules(int goalc, const char* goals[], struct Target *head, int jobs){
+    struct Watch watch;
+    if(!openWatch(&watch)){
+        perror("inotify");
+        return head;
+    }
+    watchGoals(&watch, goalc, goals, head);
+
+    while(1){
+        char **changes;
+        int count = waitForChanges(&watch, &changes);
+        if(count == WATCH_FAILED){
+            closeWatch(&watch);
+            return head;
+        }
+        int dropped = count == WATCH_DROPPED;
+        int reload = 0;
+        int affected = 0;
+        if(dropped){
+            clearStatCache();
+            for(struct Target *current = head->next; current != NULL; current = current->next){
+                current->state = UNVISITED;
+            }
+            affected = 1;
+            count = 0;
+        }
+        for(int i = 0; i < count; i++){
+            if(!fileChanged(changes[i])){
+                continue;
+            }
+            if(strcmp(changes[i], watchName(MAKEFILE)) == 0){
+                reload = 1;
+                continue;
+            }
+            affected += resetChanged(head, changes[i]);
+        }
+        if(!dropped){
+            freeChanges(changes, count);
+        }
+
+        if(retryWatches(&watch) > 0){
+            affected += resetChanged(head, NULL);
+        }
+        if(reload){
+            freeVariables();
+            freeAll(head);
+            free(head);
+            closeGraphCache();
+            head = createTarget();
+            if(!loadTargets(head)){
+                fprintf(stderr, "ERROR: Could not find uMakefile.\n");
+            }
+            affected = 1;
+        }
+        for(struct Target *current = head->next; current != NULL; current = current->next){
+            if(current->state == FAILED){
+                current->state = UNVISITED;
+                affected = 1;
+            }
+        }
+        if(!affected){
+            continue;
+        }
+
+        runGoals(goalc, goals, head, jobs);
+        if(useDigests){
+            saveBuildDb(BUILD_DB);
+        }
+        if(traceDeps){
+            saveDepDb(TRACE_DB);
+        }
+        if(useHistory){
+            saveHistory(HISTORY_FILE);
+        }
+        if(reload || dropped){
+            watchGoals(&watch, goalc, goals, head);
+        }
+    }
+}
+
+/* Check Time 
+ * name     The name of the target we are going to compare 
+ * head     The current node of a target linked list
+ * 
+ * checkTime compares the original target's last modified time to 
+ * the current dependencie's last modified time and returns 0 if 
+ * the target is newer than the dependencies and 1 if at least 
+ * one of the dependencies is newer than the target.
+ * 
+ * If a target has no dependencies and it is up to date, 
+ * 0 is returned. A dependency that does not exist (such as a target 
+ * whose rules make no file) counts as newer. The dependency names are 
+ * the ones split up once by buildGraph.
+ * 
+ * File times come from the stat cache and are compared to the 
+ * nanosecond: the target's built time with the time each dependency 
+ * last changed, which the history can set apart from the files' 
+ * modification times (see builtTime and changedTime).
+ * 
+ * The files the target's rules read the last time they ran traced 
+ * (see tracedDeps) are checked the same way after the declared 
+ * dependencies.
+ */
+int checkTime(char *name, struct Target *head){
+    int dependCount = head->depCount;
+    char** depen = head->depNames; 
+	
+    int tracedCount;
+    char** traced = tracedDeps(name, &tracedCount);
+	
+    struct FileInfo *targInfo = statFile(name);
+    if(!targInfo->exists){
+        return 1;
+    } else if(dependCount == 0 && tracedCount == 0){
+        return 0;
+    }
+    long long built = builtTime(name, targInfo->mtime);
+    for(int i = 0; i < dependCount + tracedCount; i++){		
+        const char *dep = i < dependCount ? depen[i] : traced[i - dependCount];
+        struct FileInfo *depenInfo = statFile(dep);
+        if(!depenInfo->exists || changedTime(dep, depenInfo->mtime) > built){
+            return 1;
+        }
+    }	
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ *  CS347 variables.c
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "target.h"
+#include "variables.h"
+
+/* CONSTANTS */
+
+#define VARIABLE_BUCKETS 256
+
+extern char **environ;
+
+/* The table: a fixed number of buckets, each a chain of Variable entries. */
+static struct Variable *buckets[VARIABLE_BUCKETS];
+
+/* Bumped by every definition; a memoized value is only used if it was
+ * expanded in the current generation. */
+static unsigned long generation = 1;
+
+/* The environment for rule commands, once built. Its entries from
+ * ownedStart on were allocated here; the others belong to environ. */
+static char **environment = NULL;
+static size_t ownedStart = 0;
+
+/* Buffer Structure
+ *
+ * A growable, always NUL-terminated string that an expansion is
+ * written into.
+ */
+struct Buffer {
+    char *data;
+    size_t length;
+    size_t cap;
+};
+
+/* Append Bytes
+ * buffer   The buffer to write into.
+ * bytes    The bytes to add.
+ * count    How many of them.
+ *
+ * Adds bytes to the end of buffer, doubling it when it runs out.
+ */
+static void appendBytes(struct Buffer *buffer, const char *bytes, size_t count){
+    if(buffer->length + count + 1 > buffer->cap){
+        size_t cap = buffer->cap == 0 ? 64 : buffer->cap*2;
+        while(cap < buffer->length + count + 1){
+            cap *= 2;
+        }
+        buffer->data = realloc(buffer->data, cap);
+        buffer->cap = cap;
+    }
+    memcpy(buffer->data + buffer->length, bytes, count);
+    buffer->length += count;
+    buffer->data[buffer->length] = '\0';
+}
+
+/* Find Variable
+ * name     The variable to look for.
+ *
+ * Returns the table entry for name, or NULL if the makefile did not
+ * set it.
+ */
+static struct Variable *findVariable(const char *name){
+    unsigned long hash = hashName(name);
+    struct Variable *current = buckets[hash % VARIABLE_BUCKETS];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->name, name) == 0){
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+/* Expand Into
+ * text     The string to expand.
+ * buffer   The buffer the expansion is appended to.
+ *
+ * Copies text into buffer in a single pass, replacing each ${NAME}
+ * with the value lookupVariable gives for NAME.
+ */
+static void expandInto(const char *text, struct Buffer *buffer){
+    const char *rest = text;
+    const char *dollar;
+    while((dollar = strstr(rest, "${")) != NULL){
+        const char *close = strchr(dollar+2, '}');
+        if(close == NULL){
+            fprintf(stderr, "ERROR: Mismatched braces \n");
+            exit(EXIT_FAILURE);
+        }
+        appendBytes(buffer, rest, dollar - rest);
+        char *name = strndup(dollar+2, close - dollar - 2);
+        const char *value = lookupVariable(name);
+        if(value != NULL){
+            appendBytes(buffer, value, strlen(value));
+        }
+        free(name);
+        rest = close+1;
+    }
+    appendBytes(buffer, rest, strlen(rest));
+}
+
+/* Define Variable
+ * name     The variable's name.
+ * value    Its unexpanded value.
+ *
+ * Starts a new generation, so no value memoized before the definition
+ * is used again, and drops the environment built from the old values.
+ */
+void defineVariable(const char *name, const char *value){
+    struct Variable *variable = findVariable(name);
+    if(variable == NULL){
+        variable = calloc(1, sizeof(struct Variable));
+        variable->name = strdup(name);
+        variable->hash = hashName(name);
+        variable->next = buckets[variable->hash % VARIABLE_BUCKETS];
+        buckets[variable->hash % VARIABLE_BUCKETS] = variable;
+    } else {
+        free(variable->value);
+    }
+    variable->value = strdup(value);
+    generation++;
+
+    if(environment != NULL){
+        for(size_t i = ownedStart; environment[i] != NULL; i++){
+            free(environment[i]);
+        }
+        free(environment);
+        environment = NULL;
+    }
+}
+
+/* Lookup Variable
+ * name     The variable to look up.
+ *
+ * Expands the variable's value the first time it is asked for in a
+ * generation and keeps the result. A variable met again while it is
+ * being expanded refers to itself (PATH=${PATH}:/opt/bin, say), and
+ * gets the value it has in umake's environment instead.
+ */
+const char *lookupVariable(const char *name){
+    struct Variable *variable = findVariable(name);
+    if(variable == NULL || variable->expanding){
+        return getenv(name);
+    }
+    if(variable->expanded != NULL && variable->generation == generation){
+        return variable->expanded;
+    }
+
+    struct Buffer buffer = {NULL, 0, 0};
+    variable->expanding = 1;
+    expandInto(variable->value, &buffer);
+    variable->expanding = 0;
+    free(variable->expanded);
+    variable->expanded = buffer.data;
+    variable->generation = generation;
+    return variable->expanded;
+}
+
+/* Expand
+ * orig     A string that may contain variables to be expanded.
+ *
+ * The result is written into a buffer that grows as needed, so there
+ * is no limit on the length of a line or of a value.
+ */
+char *expand(const char *orig){
+    struct Buffer buffer = {NULL, 0, 0};
+    expandInto(orig, &buffer);
+    return buffer.data;
+}
+
+/* Variable Environment
+ *
+ * Copies the pointers of environ, leaving out the names the makefile
+ * sets, and adds a NAME=value string for each makefile variable.
+ */
+char **variableEnvironment(){
+    if(environment != NULL){
+        return environment;
+    }
+    size_t count = 0;
+    while(environ[count] != NULL){
+        count++;
+    }
+    size_t variables = 0;
+    for(int i = 0; i < VARIABLE_BUCKETS; i++){
+        for(struct Variable *current = buckets[i]; current != NULL; current = current->next){
+            variables++;
+        }
+    }
+
+    environment = malloc((count + variables + 1)*sizeof(char *));
+    size_t used = 0;
+    for(size_t i = 0; i < count; i++){
+        char *equals = strchr(environ[i], '=');
+        if(equals != NULL && variables > 0){
+            char *name = strndup(environ[i], equals - environ[i]);
+            int overridden = findVariable(name) != NULL;
+            free(name);
+            if(overridden){
+                continue;
+            }
+        }
+        environment[used++] = environ[i];
+    }
+    ownedStart = used;
+    for(int i = 0; i < VARIABLE_BUCKETS; i++){
+        for(struct Variable *current = buckets[i]; current != NULL; current = current->next){
+            const char *value = lookupVariable(current->name);
+            char *entry = malloc(strlen(current->name) + strlen(value) + 2);
+            sprintf(entry, "%s=%s", current->name, value);
+            environment[used++] = entry;
+        }
+    }
+    environment[used] = NULL;
+    return environment;
+}
+
+/* Free Variables
+ *
+ * Walks every bucket, freeing each entry and its strings.
+ */
+void freeVariables(){
+    if(environment != NULL){
+        for(size_t i = ownedStart; environment[i] != NULL; i++){
+            free(environment[i]);
+        }
+        free(environment);
+        environment = NULL;
+    }
+    for(int i = 0; i < VARIABLE_BUCKETS; i++){
+        struct Variable *current = buckets[i];
+        while(current != NULL){
+            struct Variable *next = current->next;
+            free(current->name);
+            free(current->value);
+            free(current->expanded);
+            free(current);
+            current = next;
+        }
+        buckets[i] = NULL;
+    }
+}
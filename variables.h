@@ -0,0 +1,72 @@
+#ifndef __VARIABLES__H__
+#define __VARIABLES__H__
+/*
+ *  CS347 variables.h
+ *
+ */
+
+/* Variable Structure
+ *
+ * One variable set by the makefile. value is kept exactly as it was
+ * written, so a variable may refer to others that are only defined
+ * further down; expanded memoizes its value with those references
+ * expanded, and is computed the first time the variable is used.
+ * Entries are chained in the buckets of the variable table.
+ */
+struct Variable {
+    char *name;
+    unsigned long hash;
+
+    char *value;
+    char *expanded;
+    unsigned long generation;
+    int expanding;
+
+    struct Variable *next;
+};
+
+/* Define Variable
+ * name     The variable's name.
+ * value    Its unexpanded value.
+ *
+ * Adds name to umake's variable table, or replaces its value. Both
+ * strings are copied.
+ */
+void defineVariable(const char *name, const char *value);
+
+/* Lookup Variable
+ * name     The variable to look up.
+ *
+ * Returns the fully expanded value of name. Variables the makefile
+ * did not set are looked up in umake's own environment. Returns NULL
+ * if name is not set anywhere.
+ */
+const char *lookupVariable(const char *name);
+
+/* Expand
+ * orig     A string that may contain variables to be expanded.
+ *
+ * Returns a newly allocated copy of orig with every variable (starting
+ * with ${ and ending with }) replaced by its value, however long the
+ * result gets. Undefined variables expand to nothing.
+ *
+ * Example: "Hello, ${PLACE}" will expand to "Hello, World" when the
+ * makefile (or the environment) sets PLACE="World".
+ */
+char *expand(const char *orig);
+
+/* Variable Environment
+ *
+ * Returns the environment rule commands are started with: umake's own
+ * environment, with the makefile's variables (expanded) added or
+ * overriding. It is built the first time it is asked for.
+ */
+char **variableEnvironment();
+
+/* Free Variables
+ *
+ * Frees the variable table and the environment built from it.
+ */
+void freeVariables();
+
+#endif
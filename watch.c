@@ -0,0 +1,240 @@
+/*
+ *  CS347 watch.c
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "target.h"
+#include "watch.h"
+
+/* CONSTANTS */
+
+/* The events that mean a file in a watched directory may have changed. */
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/* How long to wait for more events after one arrives, in milliseconds. */
+#define SETTLE_MS 50
+
+#define EVENT_BUFFER 65536
+
+/* Open Watch
+ * watch    The watch to set up.
+ *
+ * The inotify descriptor is close-on-exec, so rule commands do not
+ * inherit it.
+ */
+int openWatch(struct Watch *watch){
+    memset(watch, 0, sizeof(struct Watch));
+    watch->fd = inotify_init1(IN_CLOEXEC);
+    return watch->fd != -1;
+}
+
+/* Watch Name
+ * path     A path as the makefile spells it.
+ *
+ * Skips every leading "./".
+ */
+const char *watchName(const char *path){
+    while(path[0] == '.' && path[1] == '/'){
+        path += 2;
+    }
+    return path;
+}
+
+/* Watch Path
+ * watch    An open watch.
+ * path     A file to be told about.
+ *
+ * Splits path at its last '/' into the directory and the prefix that
+ * events in it are reported with. A directory that cannot be watched
+ * yet is kept with a wd of -1 and counted in watch->missing.
+ */
+void watchPath(struct Watch *watch, const char *path){
+    const char *name = watchName(path);
+    const char *slash = strrchr(name, '/');
+    char *dir;
+    if(slash == NULL){
+        dir = strdup(".");
+    } else {
+        dir = strndup(name, slash == name ? 1 : (size_t)(slash - name));
+    }
+
+    unsigned long hash = hashName(dir);
+    struct WatchDir *current = watch->buckets[hash % WATCH_BUCKETS];
+    while(current != NULL){
+        if(current->hash == hash && strcmp(current->dir, dir) == 0){
+            free(dir);
+            return;
+        }
+        current = current->next;
+    }
+
+    current = malloc(sizeof(struct WatchDir));
+    current->dir = dir;
+    current->prefix = slash == NULL ? strdup("") : strndup(name, slash - name + 1);
+    current->hash = hash;
+    current->wd = inotify_add_watch(watch->fd, dir, WATCH_MASK);
+    if(current->wd == -1){
+        watch->missing++;
+    }
+    current->next = watch->buckets[hash % WATCH_BUCKETS];
+    watch->buckets[hash % WATCH_BUCKETS] = current;
+}
+
+/* Retry Watches
+ * watch    An open watch.
+ *
+ * Does nothing when every directory is already watched.
+ */
+int retryWatches(struct Watch *watch){
+    if(watch->missing == 0){
+        return 0;
+    }
+    int found = 0;
+    watch->missing = 0;
+    for(int i = 0; i < WATCH_BUCKETS; i++){
+        for(struct WatchDir *current = watch->buckets[i]; current != NULL; current = current->next){
+            if(current->wd == -1){
+                current->wd = inotify_add_watch(watch->fd, current->dir, WATCH_MASK);
+                if(current->wd == -1){
+                    watch->missing++;
+                } else {
+                    found++;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+/* Find Directory
+ * watch    An open watch.
+ * wd       The watch descriptor of an event.
+ *
+ * Returns the directory wd was given to, or NULL.
+ */
+static struct WatchDir *findDirectory(struct Watch *watch, int wd){
+    for(int i = 0; i < WATCH_BUCKETS; i++){
+        for(struct WatchDir *current = watch->buckets[i]; current != NULL; current = current->next){
+            if(current->wd == wd){
+                return current;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Wait For Changes
+ * watch    An open watch.
+ * paths    Set to a newly allocated array of the changed paths.
+ *
+ * Polls forever for the first event, then for SETTLE_MS at a time
+ * until the events stop. A path may be reported more than once. A
+ * directory that was removed (IN_IGNORED) goes back to being missing,
+ * so retryWatches picks it up again if it comes back.
+ */
+int waitForChanges(struct Watch *watch, char ***paths){
+    char buffer[EVENT_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pollFd = {watch->fd, POLLIN, 0};
+    int timeout = -1;
+    int overflow = 0;
+    int failed = 0;
+    int count = 0;
+    int cap = 16;
+    char **changed = malloc(cap*sizeof(char *));
+
+    while(1){
+        int ready = poll(&pollFd, 1, timeout);
+        if(ready == -1 && errno == EINTR){
+            continue;
+        } else if(ready == -1){
+            perror("poll");
+            failed = 1;
+            break;
+        } else if(ready == 0){
+            break;
+        }
+        ssize_t got = read(watch->fd, buffer, sizeof(buffer));
+        if(got == -1 && errno == EINTR){
+            continue;
+        } else if(got <= 0){
+            perror("read");
+            failed = 1;
+            break;
+        }
+
+        char *current = buffer;
+        while(current < buffer + got){
+            struct inotify_event *event = (struct inotify_event *)current;
+            current += sizeof(struct inotify_event) + event->len;
+            if(event->mask & IN_Q_OVERFLOW){
+                overflow = 1;
+            }
+            struct WatchDir *dir = findDirectory(watch, event->wd);
+            if(dir == NULL){
+                continue;
+            }
+            if(event->mask & IN_IGNORED){
+                dir->wd = -1;
+                watch->missing++;
+                continue;
+            }
+            if(event->len == 0){
+                continue;
+            }
+            if(count == cap){
+                cap *= 2;
+                changed = realloc(changed, cap*sizeof(char *));
+            }
+            changed[count] = malloc(strlen(dir->prefix) + strlen(event->name) + 1);
+            strcpy(changed[count], dir->prefix);
+            strcat(changed[count], event->name);
+            count++;
+        }
+        timeout = SETTLE_MS;
+    }
+
+    if(overflow || failed){
+        freeChanges(changed, count);
+        *paths = NULL;
+        return failed ? WATCH_FAILED : WATCH_DROPPED;
+    }
+    *paths = changed;
+    return count;
+}
+
+/* Free Changes
+ * paths    The array filled in by waitForChanges.
+ * count    The number of paths in it.
+ */
+void freeChanges(char **paths, int count){
+    for(int i = 0; i < count; i++){
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+/* Close Watch
+ * watch    An open watch.
+ *
+ * Closing the descriptor removes every watch at once.
+ */
+void closeWatch(struct Watch *watch){
+    close(watch->fd);
+    for(int i = 0; i < WATCH_BUCKETS; i++){
+        struct WatchDir *current = watch->buckets[i];
+        while(current != NULL){
+            struct WatchDir *next = current->next;
+            free(current->dir);
+            free(current->prefix);
+            free(current);
+            current = next;
+        }
+        watch->buckets[i] = NULL;
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef __WATCH__H__
+#define __WATCH__H__
+/*
+ *  CS347 watch.h
+ *
+ */
+
+/* The number of buckets the watched directories are chained in. */
+#define WATCH_BUCKETS 256
+
+/* What waitForChanges returns instead of a count when the kernel 
+ * dropped events, and when the inotify descriptor could not be read. */
+#define WATCH_DROPPED -1
+#define WATCH_FAILED -2
+
+/* Watched Directory Structure
+ *
+ * A directory holding at least one watched file, with the inotify
+ * watch descriptor it was given (-1 while the directory does not
+ * exist yet) and the prefix that turns an event's file name back into
+ * a path as the makefile spells it ("" for the current directory).
+ */
+struct WatchDir {
+    char *dir;
+    char *prefix;
+    unsigned long hash;
+    int wd;
+
+    struct WatchDir *next;
+};
+
+/* Watch Structure
+ *
+ * An inotify instance and the directories it watches. Directories
+ * are watched rather than files so that a file an editor replaces
+ * (by writing a new file and renaming it over the old one) is still
+ * noticed.
+ */
+struct Watch {
+    int fd;
+    int missing;
+    struct WatchDir *buckets[WATCH_BUCKETS];
+};
+
+/* Open Watch
+ * watch    The watch to set up.
+ *
+ * Creates the inotify instance. Returns 1 on success, 0 on failure.
+ */
+int openWatch(struct Watch *watch);
+
+/* Watch Path
+ * watch    An open watch.
+ * path     A file to be told about.
+ *
+ * Watches the directory path is in, unless it already is.
+ */
+void watchPath(struct Watch *watch, const char *path);
+
+/* Retry Watches
+ * watch    An open watch.
+ *
+ * Tries again to watch the directories that did not exist when they
+ * were first asked for (they may have been created since). Returns 
+ * the number of directories that are now watched. Files made in them
+ * before that were not seen, so the caller has to look at them itself.
+ */
+int retryWatches(struct Watch *watch);
+
+/* Wait For Changes
+ * watch    An open watch.
+ * paths    Set to a newly allocated array of the changed paths.
+ *
+ * Blocks until something in a watched directory changes, then keeps
+ * collecting events until none have arrived for a short while, so
+ * that a burst of writes is handled at once. Paths are reported in
+ * the form watchName gives. Returns the number of paths, 
+ * WATCH_DROPPED if the kernel dropped events and anything may have 
+ * changed, or WATCH_FAILED if poll or read failed; paths is NULL in 
+ * both cases.
+ */
+int waitForChanges(struct Watch *watch, char ***paths);
+
+/* Free Changes
+ * paths    The array filled in by waitForChanges.
+ * count    The number of paths in it.
+ */
+void freeChanges(char **paths, int count);
+
+/* Watch Name
+ * path     A path as the makefile spells it.
+ *
+ * Returns path without any leading "./", the form paths are reported
+ * in.
+ */
+const char *watchName(const char *path);
+
+/* Close Watch
+ * watch    An open watch.
+ *
+ * Closes the inotify instance and frees the directory table.
+ */
+void closeWatch(struct Watch *watch);
+
+#endif